@@ -0,0 +1,112 @@
+#ifndef MARS_ASSIGNMENTFLOW_H
+#define MARS_ASSIGNMENTFLOW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Coord.h"
+#include "Matrix.h"
+#include "PlantPool.h"
+#include "PopulationMatrix.h"
+
+namespace MARS {
+  /**
+   * AssignmentFlow - optimal assignment of people to plants, as a min-cost flow
+   *
+   * Every person in a cell some plant can reach flows either to a plant that
+   * covers the cell, at the plant's distance, or to the sink unserviced, at a
+   * cost larger than any chain of reassignments. Plants take at most their
+   * capacity. The cheapest flow therefore serves as many people as possible,
+   * and among those assignments has the least total distance.
+   *
+   * It is solved by successive shortest paths with node potentials. The
+   * current assignment is the starting flow, and the potentials are kept
+   * between solves, so after growth or a new plant only the residual edges
+   * whose reduced cost went negative are saturated, and the imbalance that
+   * leaves is routed back along shortest paths. Each phase runs Dijkstra over
+   * the reduced costs, then pushes a blocking flow through the edges left
+   * with zero reduced cost.
+   */
+  class AssignmentFlow {
+  private:
+    struct Edge {
+      std::uint32_t to;
+      std::uint32_t next; // Next edge out of the same node
+      std::int64_t cap; // Residual capacity
+      std::int64_t cost;
+    };
+
+    /* Node 0 is the sink, then come the plants, then the cells */
+    std::vector<Edge> edges; // Edge e and e ^ 1 are each other's reverse
+    std::vector<std::uint32_t> first_edge;
+    std::vector<std::int64_t> excess;
+    std::vector<std::int64_t> potential;
+    std::vector<std::int64_t> dist;
+    std::vector<std::int32_t> level;
+    std::vector<std::uint32_t> current_edge;
+    std::vector<std::uint32_t> frontier;
+    std::vector<std::pair<std::int64_t, std::uint32_t>> heap;
+    std::vector<std::uint32_t> path;
+
+    std::vector<PlantHandle> plant_of_node; // By node - 1
+    std::vector<Coord> cell_of_node; // By node - 1 - number of plants
+    std::vector<std::uint32_t> node_of_plant; // By plant id
+    Matrix<std::uint32_t> node_of_cell; // 0 if the cell is not in the network
+
+    /* Potentials of the last solve, relative to the sink's */
+    Matrix<std::int64_t> cell_potential;
+    std::vector<std::int64_t> plant_potential; // By plant id
+
+    std::size_t number_phases;
+
+    std::uint32_t addNode();
+    void addEdge(std::uint32_t from, std::uint32_t to, std::int64_t cap, std::int64_t cost, std::int64_t flow);
+    std::int64_t reducedCost(std::uint32_t e) const;
+
+    void buildNetwork(const PlantPool& plants, const PopulationMatrix& pops);
+    void guessPotentials();
+    void saturateNegativeEdges();
+
+    /*
+     * Dijkstra from every node with excess to the nearest node with a
+     * deficit, then raise the potentials by the distances found
+     */
+    void shortestPaths();
+
+    /*
+     * Push flow from the nodes with excess along edges of zero reduced cost,
+     * until no such path is left to a node with a deficit
+     */
+    void blockingFlow();
+
+    std::int64_t applyAssignment(PlantPool& plants, PopulationMatrix& pops);
+    void keepPotentials();
+
+  public:
+    /* Cost of leaving a person unserviced */
+    static const std::int64_t UNSERVICED_COST = (std::int64_t) 1 << 40;
+
+    /**
+     * Constructor
+     * Takes in the number of rows and columns of the grid
+     */
+    AssignmentFlow(int rows, int cols);
+
+    /**
+     * Reassign the people in pops to the plants optimally, updating both.
+     * Returns the change in the number of people serviced.
+     */
+    std::int64_t solve(PlantPool& plants, PopulationMatrix& pops);
+
+    /**
+     * Number of shortest path phases the last solve took
+     */
+    std::size_t phases() const {
+      return number_phases;
+    }
+  };
+}
+
+#endif
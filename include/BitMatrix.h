@@ -1,21 +1,34 @@
 #ifndef MARS_BITMATRIX_H
 #define MARS_BITMATRIX_H
 
+#include <cstdint>
+
 #include "Matrix.h"
 
 namespace MARS {
   /**
    * BitMatrix - 2D matrix of binary values, compressed in space
+   *
+   * Each row is packed into 64 bit words, column c being bit c % 64 of word
+   * c / 64, and rows start on cache line boundaries. Bits past the last column
+   * are always zero, so whole-word operations never need masking.
    */
   class BitMatrix {
+  public:
+    typedef std::uint64_t Word;
+    static const int word_bits = 64;
+
   private:
     int num_rows; // Number of rows
     int num_cols; // Number of columns
-    Matrix<int> matrix; // Matrix of integers to hold bit state
+    Matrix<Word> matrix; // One row of words per row of bits
+
+    void checkSameShape(const BitMatrix& other) const;
+
   public: 
     /**
      * Constructor
-     * Takes in number of rows and columns
+     * Takes in number of rows and columns. All bits start cleared.
      */
     BitMatrix(int rows, int cols);
 
@@ -28,6 +41,52 @@ namespace MARS {
      */
     void set(int r, int c, bool val);
 
+    /**
+     * Set or clear every bit in the rectangle of the given size whose top left
+     * corner is (r, c)
+     */
+    void fillRect(int r, int c, int rows, int cols);
+    void clearRect(int r, int c, int rows, int cols);
+
+    /* Clear every bit */
+    void clear();
+
+    /**
+     * Bulk operations with another BitMatrix of the same dimensions, a word
+     * at a time. andNot clears the bits that are set in other.
+     * Throw std::invalid_argument if the dimensions differ.
+     */
+    BitMatrix& operator&=(const BitMatrix& other);
+    BitMatrix& operator|=(const BitMatrix& other);
+    BitMatrix& operator^=(const BitMatrix& other);
+    BitMatrix& andNot(const BitMatrix& other);
+
+    /* Number of set bits in a row, and in the whole matrix */
+    std::int64_t countRow(int r) const;
+    std::int64_t count() const;
+
+    /**
+     * Column of the first set bit in row r at or after column c, or -1 if none
+     */
+    int findNextInRow(int r, int c) const;
+
+    /**
+     * Column of the first set bit in row r in columns [c, end), or -1 if none
+     */
+    int findNextInRow(int r, int c, int end) const;
+
+    /**
+     * Move (r, c) to the first set bit at or after it in row-major order.
+     * Returns false, leaving (r, c) unchanged, if there is none. Visit every
+     * set bit with:
+     *   for (int r = 0, c = 0; m.findNext(r, c); c++) { ... }
+     */
+    bool findNext(int& r, int& c) const;
+
+    /* The packed words of a row, wordsPerRow() long */
+    const Word* rowWords(int r) const;
+    int wordsPerRow() const;
+
     int numRows() const;
     int numCols() const;
   };
@@ -10,13 +10,13 @@
 namespace MARS {
 	class Clustering {
 	private:
-		static std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>> runKMeans(PopulationMatrix popMatrix, int k);
-		static std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>> runKMedians(PopulationMatrix popMatrix, int k);
+		static std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>> runKMeans(const PopulationMatrix& popMatrix, int k);
+		static std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>> runKMedians(const PopulationMatrix& popMatrix, int k);
 		static std::pair<bool, Coord> processClusteringResults (std::vector<Coord> centroids, std::vector<std::vector<Coord>> clusters);
 	public:
-		static std::pair<bool, Coord> placePlantKMeans(PopulationMatrix popMatrix, int k);
-		static std::pair<bool, Coord> placePlantKMedians(PopulationMatrix popMatrix, int k);
-		static std::pair<bool, Coord> placePlantRandom(PopulationMatrix popMatrix);
+		static std::pair<bool, Coord> placePlantKMeans(const PopulationMatrix& popMatrix, int k);
+		static std::pair<bool, Coord> placePlantKMedians(const PopulationMatrix& popMatrix, int k);
+		static std::pair<bool, Coord> placePlantRandom(const PopulationMatrix& popMatrix);
 	};
 }
 
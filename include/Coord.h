@@ -1,6 +1,7 @@
 #ifndef MARS_COORD_H
 #define MARS_COORD_H
 
+#include <cstdint>
 #include <functional>
 
 namespace MARS {
@@ -22,6 +23,24 @@ namespace MARS {
       return x == other.x && y == other.y;
     }
   };
+
+  /*
+   * Both coordinates packed into one 64 bit key, without collisions
+   */
+  inline std::uint64_t packCoord(const Coord& c) {
+    return ((std::uint64_t) (std::uint32_t) c.x << 32) | (std::uint32_t) c.y;
+  }
+
+  /*
+   * Mix every bit of a key into every bit of the hash (the splitmix64
+   * finalizer), so tables indexed by either the low or the high bits spread
+   * neighbouring keys apart
+   */
+  inline std::uint64_t mixHash(std::uint64_t key) {
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+    return key ^ (key >> 31);
+  }
 }
 
 namespace std {
@@ -32,7 +51,7 @@ namespace std {
   struct hash<MARS::Coord> {
   
     std::size_t operator()(const MARS::Coord& other) const {
-      return (other.x << 16) + other.y;
+      return (std::size_t) MARS::mixHash(MARS::packCoord(other));
     }
   
   };
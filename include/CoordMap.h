@@ -0,0 +1,287 @@
+#ifndef MARS_COORDMAP_H
+#define MARS_COORDMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Coord.h"
+
+namespace MARS {
+
+  namespace detail {
+    inline const Coord& entryKey(const Coord& c) { return c; }
+
+    template <class V>
+    const Coord& entryKey(const std::pair<Coord, V>& entry) { return entry.first; }
+
+    /*
+     * CoordTable - open addressing hash table of entries keyed by Coord
+     *
+     * Entries live in one flat array, probed linearly from the slot picked by
+     * the hash, so a lookup usually touches a single cache line. Erasing shifts
+     * the rest of the probe run back, so there are no tombstones and lookups
+     * never slow down as entries come and go.
+     *
+     * Given the number of columns of the grid its keys come from, the key is
+     * the cell's linear index, which only needs one multiply to hash well.
+     * Otherwise both coordinates are fully mixed. Coords outside the grid are
+     * still stored correctly, just with more collisions.
+     */
+    template <class Entry>
+    class CoordTable {
+    protected:
+      std::vector<Entry> slots;
+      std::vector<std::uint8_t> used; // Whether each slot holds an entry
+      std::size_t num_entries;
+      unsigned int shift; // 64 - log2(number of slots)
+      std::uint64_t grid_cols; // Columns of the grid keys are from, or 0 if unknown
+
+      static const std::size_t npos = (std::size_t) -1;
+      static const std::size_t min_slots = 16;
+
+      std::size_t home(const Coord& c) const {
+        if (grid_cols != 0) {
+          // Fibonacci hashing spreads consecutive indices evenly over the table
+          std::uint64_t index = (std::uint64_t) (std::int64_t) c.x * grid_cols + (std::uint64_t) (std::int64_t) c.y;
+          return (std::size_t) ((index * 0x9E3779B97F4A7C15ull) >> shift);
+        }
+        return (std::size_t) (mixHash(packCoord(c)) >> shift);
+      }
+
+      std::size_t mask() const {
+        return slots.size() - 1;
+      }
+
+      std::size_t findSlot(const Coord& c) const {
+        if (num_entries == 0)
+          return npos;
+        for (std::size_t i = home(c); used[i]; i = (i + 1) & mask()) {
+          if (entryKey(slots[i]) == c)
+            return i;
+        }
+        return npos;
+      }
+
+      /*
+       * Slot holding c, or a free slot for it. The bool is whether it is free,
+       * in which case the caller must fill it in.
+       */
+      std::pair<std::size_t, bool> claimSlot(const Coord& c) {
+        if ((num_entries + 1) * 10 > slots.size() * 7)
+          rehash(slots.empty() ? min_slots : slots.size() * 2);
+        std::size_t i = home(c);
+        for (; used[i]; i = (i + 1) & mask()) {
+          if (entryKey(slots[i]) == c)
+            return std::make_pair(i, false);
+        }
+        used[i] = 1;
+        num_entries++;
+        return std::make_pair(i, true);
+      }
+
+      void rehash(std::size_t number_slots) {
+        std::vector<Entry> old_slots(number_slots);
+        std::vector<std::uint8_t> old_used(number_slots, 0);
+        old_slots.swap(slots);
+        old_used.swap(used);
+        shift = 64;
+        for (std::size_t n = number_slots; n > 1; n >>= 1)
+          shift--;
+        for (std::size_t i = 0; i < old_slots.size(); i++) {
+          if (!old_used[i])
+            continue;
+          std::size_t j = home(entryKey(old_slots[i]));
+          while (used[j])
+            j = (j + 1) & mask();
+          slots[j] = std::move(old_slots[i]);
+          used[j] = 1;
+        }
+      }
+
+    public:
+
+      /*
+       * Iterates over the entries, in no particular order. Keys must not be
+       * modified through an iterator.
+       */
+      template <class Table, class Value>
+      class Iterator {
+      private:
+        Table* table;
+        std::size_t index;
+
+        void skipUnused() {
+          while (index < table->slots.size() && !table->used[index])
+            index++;
+        }
+      public:
+        Iterator(Table* table, std::size_t index): table(table), index(index) {
+          skipUnused();
+        }
+
+        Value& operator*() const { return table->slots[index]; }
+        Value* operator->() const { return &table->slots[index]; }
+
+        Iterator& operator++() {
+          index++;
+          skipUnused();
+          return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return index == other.index; }
+        bool operator!=(const Iterator& other) const { return index != other.index; }
+      };
+
+      typedef Iterator<CoordTable, Entry> iterator;
+      typedef Iterator<const CoordTable, const Entry> const_iterator;
+
+      explicit CoordTable(int grid_cols):
+        num_entries(0),
+        shift(64),
+        grid_cols(grid_cols > 0 ? grid_cols : 0)
+      {
+      }
+
+      iterator begin() { return iterator(this, 0); }
+      iterator end() { return iterator(this, slots.size()); }
+      const_iterator begin() const { return const_iterator(this, 0); }
+      const_iterator end() const { return const_iterator(this, slots.size()); }
+
+      iterator find(const Coord& c) {
+        std::size_t i = findSlot(c);
+        return i == npos ? end() : iterator(this, i);
+      }
+
+      const_iterator find(const Coord& c) const {
+        std::size_t i = findSlot(c);
+        return i == npos ? end() : const_iterator(this, i);
+      }
+
+      std::size_t count(const Coord& c) const {
+        return findSlot(c) == npos ? 0 : 1;
+      }
+
+      /*
+       * Remove c, returning the number of entries removed
+       */
+      std::size_t erase(const Coord& c) {
+        std::size_t i = findSlot(c);
+        if (i == npos)
+          return 0;
+        // Shift later entries of the probe run back into the gap, unless that
+        // would move them before their home slot
+        for (std::size_t j = (i + 1) & mask(); used[j]; j = (j + 1) & mask()) {
+          std::size_t k = home(entryKey(slots[j]));
+          bool movable = i <= j ? (k <= i || k > j) : (k <= i && k > j);
+          if (movable) {
+            slots[i] = std::move(slots[j]);
+            i = j;
+          }
+        }
+        slots[i] = Entry();
+        used[i] = 0;
+        num_entries--;
+        return 1;
+      }
+
+      /*
+       * Make room for n entries without rehashing
+       */
+      void reserve(std::size_t n) {
+        std::size_t number_slots = min_slots;
+        while (number_slots * 7 < n * 10)
+          number_slots *= 2;
+        if (number_slots > slots.size())
+          rehash(number_slots);
+      }
+
+      void clear() {
+        slots.clear();
+        used.clear();
+        num_entries = 0;
+        shift = 64;
+      }
+
+      std::size_t size() const {
+        return num_entries;
+      }
+
+      int gridCols() const {
+        return (int) grid_cols;
+      }
+
+      bool empty() const {
+        return num_entries == 0;
+      }
+    };
+  }
+
+  /*
+   * CoordMap - flat hash map from Coord to V. See detail::CoordTable.
+   */
+  template <class V>
+  class CoordMap : public detail::CoordTable<std::pair<Coord, V>> {
+  private:
+    typedef detail::CoordTable<std::pair<Coord, V>> Table;
+  public:
+    /*
+     * Constructor
+     * Takes in the number of columns of the grid keys will come from, if known
+     */
+    explicit CoordMap(int grid_cols = 0): Table(grid_cols) {}
+
+    /*
+     * Value at c, default constructed first if c is not in the map
+     */
+    V& operator[](const Coord& c) {
+      std::pair<std::size_t, bool> slot = this->claimSlot(c);
+      if (slot.second)
+        this->slots[slot.first] = std::pair<Coord, V>(c, V());
+      return this->slots[slot.first].second;
+    }
+
+    /*
+     * Value at c. Throws std::out_of_range if c is not in the map.
+     */
+    V& at(const Coord& c) {
+      std::size_t i = this->findSlot(c);
+      if (i == Table::npos)
+        throw std::out_of_range("Coord not in CoordMap");
+      return this->slots[i].second;
+    }
+
+    const V& at(const Coord& c) const {
+      std::size_t i = this->findSlot(c);
+      if (i == Table::npos)
+        throw std::out_of_range("Coord not in CoordMap");
+      return this->slots[i].second;
+    }
+  };
+
+  /*
+   * CoordSet - flat hash set of Coords. See detail::CoordTable.
+   */
+  class CoordSet : public detail::CoordTable<Coord> {
+  public:
+    /*
+     * Constructor
+     * Takes in the number of columns of the grid keys will come from, if known
+     */
+    explicit CoordSet(int grid_cols = 0): CoordTable(grid_cols) {}
+
+    /*
+     * Add c, returning whether it was not already in the set
+     */
+    bool insert(const Coord& c) {
+      std::pair<std::size_t, bool> slot = claimSlot(c);
+      if (slot.second)
+        slots[slot.first] = c;
+      return slot.second;
+    }
+  };
+}
+
+#endif
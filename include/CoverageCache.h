@@ -0,0 +1,101 @@
+#ifndef MARS_COVERAGECACHE_H
+#define MARS_COVERAGECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "Coord.h"
+#include "CoverageStencil.h"
+#include "Terrain.h"
+
+#define COVERAGE_CACHE_BYTES (64 << 20) // Default memory budget of the shared coverage cache
+
+namespace MARS {
+  /**
+   * CoverageCache - least recently used cache of serviceable areas
+   *
+   * Stencils are keyed by plant location, serving distance and the terrain's
+   * generationId(), so games built on copies of one terrain share them, and a
+   * stencil is never served for terrain it was not computed on. Stencils are
+   * immutable and reference counted: evicting one does not affect the plants
+   * holding it.
+   *
+   * Safe to use from several threads. Searches run outside the lock, so two
+   * threads missing on one key may both compute it; the first result is kept.
+   */
+  class CoverageCache {
+  public:
+    typedef std::shared_ptr<const CoverageStencil> StencilPtr;
+
+  private:
+    struct Key {
+      std::uint64_t generation_id;
+      Coord location;
+      double serve_dist;
+
+      bool operator==(const Key& other) const {
+        return generation_id == other.generation_id && location == other.location && serve_dist == other.serve_dist;
+      }
+    };
+
+    struct KeyHash {
+      std::size_t operator()(const Key& key) const;
+    };
+
+    typedef std::list<std::pair<Key, StencilPtr>> Entries;
+
+    mutable std::mutex lock;
+    Entries entries; // Most recently used first
+    std::unordered_map<Key, Entries::iterator, KeyHash> index;
+    std::size_t capacity_bytes;
+    std::size_t used_bytes;
+    std::size_t number_hits;
+    std::size_t number_misses;
+    std::size_t number_evictions;
+
+    static std::size_t stencilBytes(const CoverageStencil& stencil);
+
+    /* Drop least recently used stencils until within budget. Caller holds the lock. */
+    void evict();
+
+  public:
+
+    /**
+     * Constructor
+     * Takes in the memory budget, in bytes. The most recent stencil is always
+     * kept, even if it alone is over budget.
+     */
+    explicit CoverageCache(std::size_t capacity_bytes = COVERAGE_CACHE_BYTES);
+
+    CoverageCache(const CoverageCache&) = delete;
+    CoverageCache& operator=(const CoverageCache&) = delete;
+
+    /**
+     * The cache shared by every plant in the process
+     */
+    static CoverageCache& shared();
+
+    /**
+     * Serviceable area of a plant at location, searching for it on a miss
+     */
+    StencilPtr get(const Terrain& terrain, const Coord& location, double serve_dist);
+
+    void setCapacity(std::size_t capacity_bytes);
+    void clear();
+
+    std::size_t hits() const;
+    std::size_t misses() const;
+    std::size_t evictions() const;
+
+    /* Number of stencils held, and the memory they take */
+    std::size_t size() const;
+    std::size_t memoryUsage() const;
+  };
+}
+
+#endif
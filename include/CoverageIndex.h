@@ -0,0 +1,74 @@
+#ifndef MARS_COVERAGEINDEX_H
+#define MARS_COVERAGEINDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Coord.h"
+#include "Matrix.h"
+#include "PlantPool.h"
+
+namespace MARS {
+  /**
+   * CoverageIndex - for every cell, the plants that can serve it, nearest first
+   *
+   * Plants at the same distance are kept in the order they were added. Each
+   * list remembers where its first plant with remaining capacity was, so
+   * repeated lookups skip plants already found to be full. Plants only fill
+   * up between calls to capacityFreed(), which makes every list search again
+   * from its start, so lookups are O(1) amortized while plants are filling.
+   *
+   * Plants must stay in the pool while they are in the index.
+   */
+  class CoverageIndex {
+  private:
+    struct Candidate {
+      std::uint32_t dist; // Distance from the plant to the cell
+      std::uint32_t plant; // Id of the plant
+    };
+
+    struct CellList {
+      std::vector<Candidate> candidates; // Nearest first
+      mutable std::uint32_t first_open; // No candidate before this had remaining capacity
+      mutable std::uint32_t epoch; // Value of epoch when first_open was set
+
+      CellList(): first_open(0), epoch(0) {}
+    };
+
+    const PlantPool* plants;
+    Matrix<std::uint32_t> list_of_cell; // Position in lists plus one, or 0 if no plant covers the cell
+    std::vector<CellList> lists;
+    std::uint32_t epoch; // Bumped whenever a plant's remaining capacity grows
+
+  public:
+
+    /**
+     * Constructor
+     * Takes in the grid dimensions and the pool the plants are in
+     */
+    CoverageIndex(int rows, int cols, const PlantPool& plants);
+
+    /**
+     * Add a plant to the lists of every cell it can serve
+     */
+    void addPlant(PlantHandle plant);
+
+    /**
+     * Nearest plant that can serve c and has remaining capacity, or a null
+     * handle if there is none
+     */
+    PlantHandle bestPlant(const Coord& c) const;
+
+    /**
+     * Must be called whenever a plant's remaining capacity grows
+     */
+    void capacityFreed();
+
+    /**
+     * Number of plants that can serve c
+     */
+    int numberCovering(const Coord& c) const;
+  };
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef MARS_COVERAGESTENCIL_H
+#define MARS_COVERAGESTENCIL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Coord.h"
+
+namespace MARS {
+  /**
+   * CoverageShape - cells and distances of a serviceable area, relative to
+   * the plant
+   *
+   * Cells are kept as their index in the shape's bounding box, row by row,
+   * in ascending order, with the distances in a parallel array. Distances
+   * are whole numbers, as terrain step costs are. An index of where each row
+   * starts narrows a lookup down to one row, which is then binary searched.
+   *
+   * Shapes are immutable, so one can be shared by every plant it fits.
+   */
+  class CoverageShape {
+  private:
+    int first_row; // Offset of the bounding box's top row from the plant
+    int first_col; // Offset of the bounding box's left column from the plant
+    int width; // Columns of the bounding box
+    bool is_interned; // Whether the shape is one of the shared diamonds
+    std::vector<std::uint32_t> cells; // Bounding box indices, ascending
+    std::vector<std::uint32_t> dists; // Distance to each cell
+    std::vector<std::uint32_t> row_begin; // Position of the first cell of each row, and the end
+
+    CoverageShape(int radius, std::uint32_t step_cost);
+
+    void buildRowIndex();
+
+  public:
+
+    /**
+     * Constructor
+     * Takes in the plant's location, the columns of its grid, and entries of
+     * (grid cell index << 32 | distance), which must be sorted and hold each
+     * cell once
+     */
+    CoverageShape(const Coord& origin, int grid_cols, const std::vector<std::uint64_t>& entries);
+
+    /**
+     * The cells within radius steps of the plant, except the plant's own, each
+     * step costing step_cost. Shapes are built once and shared.
+     */
+    static std::shared_ptr<const CoverageShape> diamond(int radius, std::uint32_t step_cost);
+
+    /**
+     * Position of the cell at (dx, dy) from the plant, or -1 if not covered
+     */
+    int find(int dx, int dy) const;
+
+    /* Offset of the cell at position i from the plant */
+    int rowOffsetAt(std::size_t i) const {
+      return first_row + (int) (cells[i] / width);
+    }
+
+    int colOffsetAt(std::size_t i) const {
+      return first_col + (int) (cells[i] % width);
+    }
+
+    std::uint32_t distanceAt(std::size_t i) const {
+      return dists[i];
+    }
+
+    std::size_t size() const {
+      return cells.size();
+    }
+
+    bool interned() const {
+      return is_interned;
+    }
+
+    /**
+     * Heap memory held, in bytes
+     */
+    std::size_t memoryUsage() const;
+  };
+
+  /**
+   * CoverageStencil - the cells a plant can serve, and their distances
+   *
+   * A CoverageShape placed at the plant's location. Positions 0 to size() - 1
+   * follow ascending linear cell index, x * grid columns + y, and are stable,
+   * so per-cell state of the plant can be kept in arrays parallel to the
+   * stencil.
+   */
+  class CoverageStencil {
+  private:
+    std::shared_ptr<const CoverageShape> area; // Null when empty
+    Coord origin; // Location of the plant
+    int grid_cols; // Columns of the grid the cells are in
+
+  public:
+
+    /*
+     * Iterates over (cell, distance) pairs in cell order
+     */
+    class Iterator {
+    private:
+      const CoverageStencil* stencil;
+      std::size_t index;
+    public:
+      Iterator(const CoverageStencil* stencil, std::size_t index): stencil(stencil), index(index) {}
+
+      std::pair<Coord, double> operator*() const {
+        return std::make_pair(stencil->coordAt(index), stencil->distanceAt(index));
+      }
+
+      Iterator& operator++() {
+        index++;
+        return *this;
+      }
+
+      bool operator==(const Iterator& other) const { return index == other.index; }
+      bool operator!=(const Iterator& other) const { return index != other.index; }
+    };
+
+    /**
+     * Constructor
+     * Takes in the number of columns of the grid. The stencil starts empty.
+     */
+    explicit CoverageStencil(int grid_cols = 0);
+
+    /**
+     * Constructor
+     * Takes in the shape, the plant's location and the number of columns of
+     * the grid. The shape must lie within the grid.
+     */
+    CoverageStencil(std::shared_ptr<const CoverageShape> shape, const Coord& origin, int grid_cols);
+
+    /**
+     * Position of c in the stencil, or -1 if it is not covered
+     */
+    int find(const Coord& c) const {
+      return area ? area->find(c.x - origin.x, c.y - origin.y) : -1;
+    }
+
+    bool contains(const Coord& c) const {
+      return find(c) >= 0;
+    }
+
+    Coord coordAt(std::size_t i) const {
+      return Coord(origin.x + area->rowOffsetAt(i), origin.y + area->colOffsetAt(i));
+    }
+
+    double distanceAt(std::size_t i) const {
+      return area->distanceAt(i);
+    }
+
+    std::uint32_t cellIndexAt(std::size_t i) const {
+      Coord c = coordAt(i);
+      return (std::uint32_t) c.x * grid_cols + c.y;
+    }
+
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, size()); }
+
+    std::size_t size() const {
+      return area ? area->size() : 0;
+    }
+
+    bool empty() const {
+      return size() == 0;
+    }
+
+    int gridCols() const {
+      return grid_cols;
+    }
+
+    const std::shared_ptr<const CoverageShape>& shape() const {
+      return area;
+    }
+
+    /**
+     * Heap memory held, in bytes. Interned shapes are owned by the intern
+     * table, so are not counted.
+     */
+    std::size_t memoryUsage() const;
+  };
+}
+
+#endif
@@ -1,10 +1,18 @@
 #ifndef MARS_GAME_H
 #define MARS_GAME_H
 
+#include <cstdint>
+#include <memory>
 #include <queue>
+#include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
+#include "AssignmentFlow.h"
+#include "CoverageIndex.h"
 #include "Matrix.h"
+#include "PlantPool.h"
 #include "PopulationGen.h"
 #include "Terrain.h"
 #include "PopulationMatrix.h"
@@ -12,6 +20,19 @@
 
 namespace MARS {
 
+  /*
+   * How a Game assigns people to plants.
+   * GREEDY_ASSIGNMENT: each person goes to the nearest plant with room, cell
+   * by cell, and new plants take people from farther ones.
+   * MIN_COST_FLOW_ASSIGNMENT: every step, the assignment is re-solved as a
+   * min-cost flow (see AssignmentFlow), serving as many people as possible
+   * at the least total distance.
+   */
+  enum AssignmentEngine {
+    GREEDY_ASSIGNMENT,
+    MIN_COST_FLOW_ASSIGNMENT
+  };
+
   /*
    * Game - a simulation of a growing population of people on a terrain, in which power plants are placed to support the existing and future population
    */
@@ -22,9 +43,9 @@ namespace MARS {
   public:
     class RLState {
     public:
-      Matrix<int> totalPops;
-      Matrix<int> unservicedPops;
-      Matrix<int> servicedPops;
+      Matrix<PopCount> totalPops;
+      Matrix<PopCount> unservicedPops;
+      Matrix<PopCount> servicedPops;
 
       Matrix<int> terrain;
 
@@ -47,8 +68,31 @@ namespace MARS {
 
     Terrain terrain;
     PopulationGen pop_gen;
-    std::vector<Plant*> plants_in_service;
+    PlantPool plants_in_service;
+    CoverageIndex coverage_index; // Plants that can serve each cell, nearest first
     PopulationMatrix pop_matrix; //Integer matrix containing population density
+    Matrix<std::uint32_t> plant_grid; //Id + 1 of the plant at each cell, 0 if there is none
+
+    /*
+     * Active-cell worklist. Only cells a plant with room can reach may take
+     * on unserviced people, so processUnservicedPopulation only visits the
+     * areas of plants that have gained room or seen new people since it last
+     * ran: new plants, plants that lost people to a nearer plant, and on
+     * growth every plant with room. Cells left unserviced are dropped until
+     * one of their plants is activated again.
+     */
+    std::vector<PlantHandle> activated_plants;
+    std::vector<std::uint8_t> is_activated_plant; // By plant id
+    std::vector<std::uint32_t> active_cells; // Linear cell indices
+    Matrix<std::uint8_t> is_active_cell;
+
+    void activatePlant(PlantHandle);
+
+    AssignmentEngine assignment_engine;
+    std::unique_ptr<AssignmentFlow> assignment_flow; // Made when first used
+
+    /* Re-solve the assignment as a min-cost flow */
+    void solveAssignmentFlow();
     int number_new_plants; //Number of new plants built in current turn
     int number_plants_in_service; //Number of plants in service, discluding newly built plants
     int number_pop_serviced; //Number of people serviced by plants
@@ -75,7 +119,26 @@ namespace MARS {
       double initial_cost,
       double operating_cost,
       double profit_margin,
-      double unserviced_penalty
+      double unserviced_penalty,
+      const std::string& storage_path = "",
+      bool sparse_population = false
+    );
+
+    /*
+     * Game on a copy of an existing terrain. Games on copies of one terrain
+     * share serviceable areas through CoverageCache::shared(), so repeated
+     * runs do not redo the searches.
+     */
+    Game(
+      const Terrain& terrain,
+      int number_turns,
+      int default_capacity,
+      double servable_distance,
+      double initial_cost,
+      double operating_cost,
+      double profit_margin,
+      double unserviced_penalty,
+      bool sparse_population = false
     );
     ~Game();    
 
@@ -85,6 +148,13 @@ namespace MARS {
     RLState rlState;
 
 
+    /*
+     * Choose how people are assigned to plants from the next step on. Games
+     * start with GREEDY_ASSIGNMENT.
+     */
+    void setAssignmentEngine(AssignmentEngine engine);
+    AssignmentEngine assignmentEngine() const;
+
     /* Advance the game's progress by one time step */
     void step(bool add_plant, const Coord& plant_coord);
     double calculateObjective() const;
@@ -102,18 +172,49 @@ namespace MARS {
     double plantServableDistance() const;
     PopulationMatrix popMatrixCopy() const;
     Terrain terrainCopy() const;
+
+    /*
+     * Read-only access to the population and terrain state, without copying.
+     * References stay valid for the lifetime of the game.
+     */
+    const PopulationMatrix& popMatrixView() const;
+    const Terrain& terrainView() const;
     std::pair<int, int> sizeXY() const;
 
-    std::pair<Plant*, bool> findBestPlant(const Coord& person_loc) const;
+    /*
+     * Every plant built so far, including those built this turn. Handles stay
+     * valid for the lifetime of the game.
+     */
+    const PlantPool& plants() const;
+
+    std::pair<PlantHandle, bool> findBestPlant(const Coord& person_loc) const;
     void processUnservicedElement(int i, int j);
     void processUnservicedPopulation();
-    std::queue<Plant*> processServicedPop(Plant*, const Coord&, std::unordered_map<Plant*,int>, std::queue<Plant*>&);
+    void processServicedPop(PlantHandle, const Coord&, const std::vector<PlantServing>&, std::queue<PlantHandle>&);
+
+    /*
+     * Build a plant at a coordinate. Throws std::invalid_argument if a plant
+     * cannot be placed there.
+     */
+    PlantHandle createPlant(const Coord&);
+    std::queue<PlantHandle> considerNewPlant(PlantHandle, bool);
+    void processTouchedPlants(std::queue<PlantHandle>);
+
+    /*
+     * Whether a plant stands at a coordinate, in O(1). False outside the map.
+     */
+    bool isPlantPresent(const Coord&) const;
 
-    Plant* createPlant(const Coord&);
-    std::queue<Plant*> considerNewPlant(Plant*, bool);
-    void processTouchedPlants(std::queue<Plant*>);
+    /*
+     * The plant at a coordinate, or a null handle if there is none
+     */
+    PlantHandle plantAt(const Coord&) const;
 
-    bool isPlantPresent(const Coord&) const;
+    /*
+     * Whether a plant can be built at a coordinate: inside the map, on land
+     * that is not mountain, and not on another plant
+     */
+    bool canPlacePlant(const Coord&) const;
     double fundsForCurrentStep() const;
   };
 }
@@ -7,6 +7,7 @@
 
 #include "Game.h"
 #include "Coord.h"
+#include "CoordMap.h"
 #include "Matrix.h"
 #include "BitMatrix.h"
 
@@ -15,17 +16,17 @@ namespace MARS {
   private:
     Game* game;
     int avg_cover;
-    std::unordered_map<Coord, std::vector<Coord>> bin_assign;
+    CoordMap<std::vector<Coord>> bin_assign;
 
     // Previous game state
-    Matrix<int> last_pop_matrix;
+    Matrix<PopCount> last_pop_matrix;
     int last_diff;
     int last_diff_slope;
     
     int binXY();
-    Coord nearestValidCoord(Coord c, Terrain& terrain);
+    Coord nearestValidCoord(Coord c, const Terrain& terrain);
     Coord plantLocationInBin(Coord bin);
-    std::unordered_set<Coord> unservicedCoords(bool old);
+    CoordSet unservicedCoords(bool old);
   public:
     GrowthPrediction(Game* game, int sample_size);
 
@@ -3,41 +3,239 @@
 
 #include <memory>
 #include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "MatrixFile.h"
+#include "MatrixLayout.h"
+#include "MatrixView.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define MATRIX_ALIGNMENT 64 // Cache line size, in bytes
+#define MATRIX_HUGE_PAGE_SIZE (2 * 1024 * 1024) // Transparent huge page size, in bytes
 
 namespace MARS {
+
+  /*
+   * MatrixFlags - storage options for a Matrix, may be or-ed together
+   */
+  enum MatrixFlags {
+    MATRIX_DENSE = 0,      // Rows are packed back to back
+    MATRIX_PADDED = 1,     // Each row is padded out to a whole number of cache lines
+    MATRIX_HUGE_PAGES = 2, // Buffers of at least a huge page are backed by huge pages
+    MATRIX_GRID = MATRIX_PADDED | MATRIX_HUGE_PAGES // Storage for full size simulation grids
+  };
+
+  namespace detail {
+    /*
+     * Number of Matrix buffers allocated so far in this process. Used to check
+     * that hot loops do not allocate.
+     */
+    inline std::atomic<std::size_t>& allocationCount() {
+      static std::atomic<std::size_t> count(0);
+      return count;
+    }
+
+    /*
+     * Allocate `bytes` of memory aligned to `alignment`, which must be a power of two.
+     * Throws std::bad_alloc on failure.
+     */
+    inline void* alignedAllocate(std::size_t bytes, std::size_t alignment) {
+      if (bytes == 0) bytes = alignment;
+      bytes = (bytes + alignment - 1) / alignment * alignment;
+      #ifdef _WIN32
+      void* mem = _aligned_malloc(bytes, alignment);
+      if (mem == nullptr)
+        throw std::bad_alloc();
+      #else
+      void* mem = nullptr;
+      if (posix_memalign(&mem, alignment, bytes) != 0)
+        throw std::bad_alloc();
+      #endif
+      return mem;
+    }
+
+    inline void alignedFree(void* mem) {
+      #ifdef _WIN32
+      _aligned_free(mem);
+      #else
+      std::free(mem);
+      #endif
+    }
+
+    /*
+     * Ask the kernel to back a buffer with transparent huge pages. Only a hint,
+     * silently ignored where unsupported.
+     */
+    inline void adviseHugePages(void* mem, std::size_t bytes) {
+      #ifdef MADV_HUGEPAGE
+      madvise(mem, bytes, MADV_HUGEPAGE);
+      #else
+      (void) mem;
+      (void) bytes;
+      #endif
+    }
+  }
+
   /*
    * Matrix - a 2D matrix of elements
+   *
+   * Storage is aligned to a cache line and ordered by the Layout policy (see
+   * MatrixLayout.h). With the default RowMajorLayout, rows start `stride()`
+   * elements apart, which equals the number of columns unless MATRIX_PADDED was
+   * requested. Views, row pointers and the kernels are only available row-major;
+   * other layouts can be exported with rowMajorCopy().
+   *
+   * Storage is normally on the heap, but row-major matrices of plain numbers
+   * may instead be backed by a memory-mapped file (see createFile/openFile),
+   * which the kernel pages in on demand. Copies are always on the heap.
    */
-  template <class T>
+  template <class T, class Layout = RowMajorLayout>
   class Matrix {
   private:
     unsigned int num_rows; // Number of rows
     unsigned int num_cols; // Number of columns
+    Layout layout; // Maps coordinates to offsets into matrix
+    int flags; // MatrixFlags the storage was created with
     T* matrix; // Matrix memory
+    detail::MatrixMapping mapping; // Backing file mapping, base is null for heap storage
+
+    /*
+     * Number of columns each row is padded out to a multiple of: a whole cache line if requested.
+     */
+    static unsigned int columnMultiple(int flags) {
+      if (!(flags & MATRIX_PADDED) || MATRIX_ALIGNMENT % sizeof(T) != 0)
+        return 1;
+      return MATRIX_ALIGNMENT / sizeof(T);
+    }
+
+    std::size_t storageSize() const {
+      return layout.size();
+    }
+
+    /*
+     * Allocate and default construct storage for the current dimensions.
+     */
+    void allocate() {
+      std::size_t items = storageSize();
+      std::size_t bytes = items * sizeof(T);
+      bool huge = (flags & MATRIX_HUGE_PAGES) && bytes >= MATRIX_HUGE_PAGE_SIZE;
+      std::size_t alignment = huge ? MATRIX_HUGE_PAGE_SIZE : MATRIX_ALIGNMENT;
+      if (alignment < alignof(T))
+        alignment = alignof(T);
+      void* mem = detail::alignedAllocate(bytes, alignment);
+      detail::allocationCount()++;
+      if (huge)
+        detail::adviseHugePages(mem, bytes);
+      matrix = static_cast<T*>(mem);
+      std::size_t i = 0;
+      try {
+        for (; i < items; i++) {
+          new (matrix + i) T();
+        }
+      } catch (...) {
+        destroy(i);
+        throw;
+      }
+    }
+
+    /*
+     * Destroy the first `items` elements and free the storage.
+     */
+    void destroy(std::size_t items) {
+      if (matrix == nullptr)
+        return;
+      if (mapping.base != nullptr) {
+        detail::unmapMatrixFile(mapping);
+        mapping = detail::MatrixMapping();
+        matrix = nullptr;
+        return;
+      }
+      for (std::size_t i = 0; i < items; i++) {
+        matrix[i].~T();
+      }
+      detail::alignedFree(matrix);
+      matrix = nullptr;
+    }
+
+    void release() {
+      destroy(storageSize());
+    }
+
+    /*
+     * Adopt a mapped matrix file as storage.
+     */
+    Matrix(const detail::MatrixMapping& mapping, unsigned int rows, unsigned int cols, int flags):
+      num_rows(rows),
+      num_cols(cols),
+      layout(rows, cols, columnMultiple(flags)),
+      flags(flags),
+      matrix(static_cast<T*>(mapping.data)),
+      mapping(mapping)
+    {
+    }
+
+    static void checkFileBackable() {
+      static_assert(Layout::row_major, "File-backed matrices must be row-major");
+      static_assert(detail::MatrixDType<T>::code != 0, "File-backed matrices must hold plain numbers");
+    }
+
+    void copyElements(const MatrixView<T>& view, std::true_type /* row major */) {
+      for (unsigned int r = 0; r < num_rows; r++) {
+        std::copy(view.rowPtr(r), view.rowPtr(r) + num_cols, rowPtr(r));
+      }
+    }
+
+    void copyElements(const MatrixView<T>& view, std::false_type /* row major */) {
+      for (unsigned int r = 0; r < num_rows; r++) {
+        const T* src = view.rowPtr(r);
+        for (unsigned int c = 0; c < num_cols; c++) {
+          matrix[layout.index(r, c)] = src[c];
+        }
+      }
+    }
 
   public:
 
     /*
      * Constructor
-     * Takes in number of rows and columns
-     */ 
-    Matrix(unsigned int rows, unsigned int cols):
+     * Takes in number of rows and columns, and optionally a set of MatrixFlags
+     */
+    Matrix(unsigned int rows, unsigned int cols, int flags = MATRIX_DENSE):
       num_rows(rows),
       num_cols(cols),
-      matrix(new T[rows * cols]) 
+      layout(rows, cols, columnMultiple(flags)),
+      flags(flags),
+      matrix(nullptr),
+      mapping()
     {
-      resetToDefault();
+      allocate();
     };
 
     /** Copy constructor */
     Matrix(const Matrix& other):
       num_rows(other.num_rows),
       num_cols(other.num_cols),
-      matrix(new T[other.num_rows * other.num_cols]) 
+      layout(other.layout),
+      flags(other.flags),
+      matrix(nullptr),
+      mapping()
     {
-      unsigned int items = other.num_rows * other.num_cols;
-      for (unsigned int i = 0; i < items; i++) {
+      allocate();
+      std::size_t items = storageSize();
+      for (std::size_t i = 0; i < items; i++) {
         matrix[i] = T(other.matrix[i]);
       }
     }
@@ -46,34 +244,68 @@ namespace MARS {
     Matrix(Matrix&& other):
       num_rows(other.num_rows),
       num_cols(other.num_cols),
-      matrix(other.matrix)
+      layout(other.layout),
+      flags(other.flags),
+      matrix(other.matrix),
+      mapping(other.mapping)
     {
       other.matrix = nullptr;
+      other.mapping = detail::MatrixMapping();
     }
 
-    /** Copy assignment operator */
+    /**
+     * Copy assignment operator, reuses the existing storage when the shapes
+     * match. A file-backed matrix then stays file-backed.
+     */
     Matrix& operator=(const Matrix& other)
     {
       if (this != &other) { // Avoid deleting ourselves
+        bool reuse = matrix != nullptr && layout == other.layout;
+        if (!reuse)
+          release();
+        // Take the source's shape and flags first, so new storage is padded and paged like it
         num_rows = other.num_rows;
         num_cols = other.num_cols;
-        delete[] matrix;
-        unsigned int items = num_rows * num_cols;
-        matrix = new T[items];
-        for (unsigned int i = 0; i < items; i++) {
+        layout = other.layout;
+        flags = other.flags;
+        if (!reuse)
+          allocate();
+        std::size_t items = storageSize();
+        for (std::size_t i = 0; i < items; i++) {
           matrix[i] = T(other.matrix[i]);
         }
       }
       return *this;
     }
 
+    /**
+     * Construct a copy of the data in a view, with the given MatrixFlags
+     */
+    explicit Matrix(const MatrixView<T>& view, int flags = MATRIX_DENSE):
+      num_rows(view.numberRows()),
+      num_cols(view.numberCols()),
+      layout(view.numberRows(), view.numberCols(), columnMultiple(flags)),
+      flags(flags),
+      matrix(nullptr),
+      mapping()
+    {
+      allocate();
+      copyFrom(view);
+    }
+
     /** Move assignment operator */
-    Matrix& operator==(Matrix&& other) {
-      num_rows = other.num_rows;
-      num_cols = other.num_cols;
-      delete[] matrix;
-      matrix = other.matrix;
-      other.matrix = nullptr;
+    Matrix& operator=(Matrix&& other) {
+      if (this != &other) {
+        release();
+        num_rows = other.num_rows;
+        num_cols = other.num_cols;
+        layout = other.layout;
+        flags = other.flags;
+        matrix = other.matrix;
+        mapping = other.mapping;
+        other.matrix = nullptr;
+        other.mapping = detail::MatrixMapping();
+      }
       return *this;
     }
     /**
@@ -81,12 +313,12 @@ namespace MARS {
      */
     T& at(unsigned int r, unsigned int c) {
       #ifdef FLAG_MATRIX_BOUNDS_CHECKING
-      if (r < 0 || r >= num_rows) 
+      if (r < 0 || r >= num_rows)
         throw -1;
       if (c < 0 || c >= num_cols)
         throw -1;
       #endif
-      return matrix[r * num_cols + c];
+      return matrix[layout.index(r, c)];
     }
 
     /**
@@ -99,14 +331,22 @@ namespace MARS {
       if (c < 0 || c >= num_cols)
         throw -1;
       #endif
-      return matrix[r * num_cols + c];
+      return matrix[layout.index(r, c)];
     }
 
 
     T* ptr() const {
       return matrix;
     }
-    
+
+    /**
+     * Pointer to the first element of a row. Rows are cache line aligned when padded.
+     */
+    T* rowPtr(unsigned int r) const {
+      static_assert(Layout::row_major, "rowPtr() requires a row-major layout");
+      return matrix + layout.index(r, 0);
+    }
+
     unsigned int numberRows() const {
       return num_rows;
     }
@@ -115,12 +355,131 @@ namespace MARS {
       return num_cols;
     }
 
+    /**
+     * Number of elements between the starts of consecutive rows. Never less than numberCols().
+     */
+    unsigned int stride() const {
+      static_assert(Layout::row_major, "stride() requires a row-major layout");
+      return layout.stride();
+    }
+
+    int storageFlags() const {
+      return flags;
+    }
+
+    /**
+     * Read-only view of the whole matrix
+     */
+    MatrixView<T> view() const {
+      static_assert(Layout::row_major, "view() requires a row-major layout, see rowMajorCopy()");
+      return MatrixView<T>(matrix, num_rows, num_cols, layout.stride());
+    }
+
+    /**
+     * Dense row-major copy of this matrix, whatever its layout. This is the
+     * form handed to Python through the buffer protocol.
+     */
+    Matrix<T> rowMajorCopy() const {
+      Matrix<T> copy(num_rows, num_cols);
+      for (unsigned int r = 0; r < num_rows; r++) {
+        T* out = copy.rowPtr(r);
+        for (unsigned int c = 0; c < num_cols; c++) {
+          out[c] = matrix[layout.index(r, c)];
+        }
+      }
+      return copy;
+    }
+
+    /**
+     * Overwrite this matrix with the contents of a view. Storage is only
+     * reallocated if the dimensions differ.
+     */
+    void copyFrom(const MatrixView<T>& view) {
+      if (matrix == nullptr || view.numberRows() != num_rows || view.numberCols() != num_cols) {
+        release();
+        num_rows = view.numberRows();
+        num_cols = view.numberCols();
+        layout = Layout(num_rows, num_cols, columnMultiple(flags));
+        allocate();
+      }
+      copyElements(view, std::integral_constant<bool, Layout::row_major>());
+    }
+
+    /**
+     * Create a file-backed matrix at path, replacing any existing file. The
+     * elements start out zeroed. Only MATRIX_PADDED is meaningful in flags.
+     * Throws std::runtime_error if the file cannot be created.
+     */
+    static Matrix createFile(const std::string& path, unsigned int rows, unsigned int cols, int flags = MATRIX_DENSE) {
+      checkFileBackable();
+      flags &= MATRIX_PADDED;
+      detail::MatrixFileHeader header = detail::MatrixFileHeader();
+      header.dtype = detail::MatrixDType<T>::code;
+      header.element_size = sizeof(T);
+      header.rows = rows;
+      header.cols = cols;
+      header.stride = Layout(rows, cols, columnMultiple(flags)).stride();
+      return Matrix(detail::createMatrixFile(path, header), rows, cols, flags);
+    }
+
+    /**
+     * Reopen a matrix previously made with createFile. Changes are written back
+     * to the file. Throws std::runtime_error if it is missing or holds another type.
+     */
+    static Matrix openFile(const std::string& path) {
+      checkFileBackable();
+      detail::MatrixFileHeader header = detail::MatrixFileHeader();
+      header.dtype = detail::MatrixDType<T>::code;
+      header.element_size = sizeof(T);
+      detail::MatrixMapping mapping = detail::openMatrixFile(path, header);
+      int flags = MATRIX_DENSE;
+      if (header.stride != header.cols)
+        flags = MATRIX_PADDED;
+      if (Layout(header.rows, header.cols, columnMultiple(flags)).stride() != header.stride) {
+        detail::unmapMatrixFile(mapping);
+        throw std::runtime_error("Matrix file '" + path + "' has an unsupported row stride");
+      }
+      return Matrix(mapping, header.rows, header.cols, flags);
+    }
+
+    /**
+     * Whether path holds a matrix file of this element type and the given dimensions
+     */
+    static bool fileMatches(const std::string& path, unsigned int rows, unsigned int cols) {
+      detail::MatrixFileHeader header;
+      return detail::readMatrixFileHeader(path, header)
+        && header.dtype == detail::MatrixDType<T>::code
+        && header.element_size == sizeof(T)
+        && header.rows == rows
+        && header.cols == cols;
+    }
+
+    bool fileBacked() const {
+      return mapping.base != nullptr;
+    }
+
+    /**
+     * Write changes to a file-backed matrix back to disk. No-op on the heap.
+     */
+    void sync() const {
+      if (mapping.base != nullptr)
+        detail::syncMatrixFile(mapping);
+    }
+
+    /**
+     * Hint how a file-backed matrix is about to be accessed. No-op on the heap.
+     */
+    void advise(MatrixAccess access) const {
+      if (mapping.base != nullptr)
+        detail::adviseMatrixFile(mapping, access);
+    }
+
     void resetToDefault() {
-      std::fill(matrix, matrix + (num_rows*num_cols), T());
+      std::fill(matrix, matrix + storageSize(), T());
     }
 
     ~Matrix() {
-      delete[] matrix;
+      release();
     }
   };
 }
@@ -0,0 +1,324 @@
+#ifndef MARS_MATRIXEXPR_H
+#define MARS_MATRIXEXPR_H
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "Matrix.h"
+#include "MatrixView.h"
+
+namespace MARS {
+  /*
+   * Lazy elementwise matrix expressions
+   *
+   * Arithmetic (+, -, *), min, max and comparisons (<, >, <=, >=) between
+   * Matrix, MatrixView, scalars and other expressions build a tree of small
+   * value types instead of computing anything. The tree is evaluated in a single
+   * pass when it is assigned into a destination with assign()/addAssign() or
+   * reduced with sum()/count()/maxOf(), so intermediate results never touch
+   * memory. Operands must stay alive until the expression is evaluated.
+   */
+
+  /*
+   * MatrixExprTag - base of every expression node. A node provides value_type,
+   * numberRows(), numberCols() and value_type at(r, c) const.
+   */
+  class MatrixExprTag {};
+
+  /*
+   * Leaf node reading from row-major storage
+   */
+  template <class T>
+  class ViewExpr : public MatrixExprTag {
+  private:
+    MatrixView<T> view;
+  public:
+    typedef T value_type;
+
+    explicit ViewExpr(const MatrixView<T>& view): view(view) {}
+
+    unsigned int numberRows() const { return view.numberRows(); }
+    unsigned int numberCols() const { return view.numberCols(); }
+    T at(unsigned int r, unsigned int c) const { return view.rowPtr(r)[c]; }
+  };
+
+  /*
+   * Leaf node broadcasting a single value. Has no dimensions of its own.
+   */
+  template <class T>
+  class ScalarExpr : public MatrixExprTag {
+  private:
+    T value;
+  public:
+    typedef T value_type;
+
+    explicit ScalarExpr(T value): value(value) {}
+
+    unsigned int numberRows() const { return 0; }
+    unsigned int numberCols() const { return 0; }
+    T at(unsigned int, unsigned int) const { return value; }
+  };
+
+  /*
+   * Interior node combining two operands elementwise with Op::apply
+   */
+  template <class Op, class L, class R>
+  class BinaryExpr : public MatrixExprTag {
+  private:
+    L left;
+    R right;
+  public:
+    typedef decltype(Op::apply(std::declval<typename L::value_type>(), std::declval<typename R::value_type>())) value_type;
+
+    BinaryExpr(const L& left, const R& right): left(left), right(right) {}
+
+    unsigned int numberRows() const {
+      return left.numberRows() != 0 ? left.numberRows() : right.numberRows();
+    }
+    unsigned int numberCols() const {
+      return left.numberCols() != 0 ? left.numberCols() : right.numberCols();
+    }
+    value_type at(unsigned int r, unsigned int c) const {
+      return Op::apply(left.at(r, c), right.at(r, c));
+    }
+  };
+
+  namespace expr {
+    struct Plus { template <class A, class B> static auto apply(A a, B b) -> decltype(a + b) { return a + b; } };
+    struct Minus { template <class A, class B> static auto apply(A a, B b) -> decltype(a - b) { return a - b; } };
+    struct Multiply { template <class A, class B> static auto apply(A a, B b) -> decltype(a * b) { return a * b; } };
+    struct Min {
+      template <class A, class B> static typename std::common_type<A, B>::type apply(A a, B b) { return b < a ? b : a; }
+    };
+    struct Max {
+      template <class A, class B> static typename std::common_type<A, B>::type apply(A a, B b) { return a < b ? b : a; }
+    };
+    struct Less { template <class A, class B> static bool apply(A a, B b) { return a < b; } };
+    struct Greater { template <class A, class B> static bool apply(A a, B b) { return a > b; } };
+    struct LessEqual { template <class A, class B> static bool apply(A a, B b) { return a <= b; } };
+    struct GreaterEqual { template <class A, class B> static bool apply(A a, B b) { return a >= b; } };
+
+    /*
+     * AsExpr - maps an operand type to the node that represents it. Undefined
+     * for types that cannot take part in an expression.
+     */
+    template <class X, class Enable = void>
+    struct AsExpr {};
+
+    template <class T>
+    struct AsExpr<Matrix<T>> {
+      typedef ViewExpr<T> type;
+      static type wrap(const Matrix<T>& m) { return type(m.view()); }
+    };
+
+    template <class T>
+    struct AsExpr<MatrixView<T>> {
+      typedef ViewExpr<T> type;
+      static type wrap(const MatrixView<T>& v) { return type(v); }
+    };
+
+    template <class X>
+    struct AsExpr<X, typename std::enable_if<std::is_base_of<MatrixExprTag, X>::value>::type> {
+      typedef X type;
+      static const X& wrap(const X& x) { return x; }
+    };
+
+    template <class X>
+    struct AsExpr<X, typename std::enable_if<std::is_arithmetic<X>::value>::type> {
+      typedef ScalarExpr<X> type;
+      static type wrap(X x) { return type(x); }
+    };
+
+    /* Whether X can take part in an expression */
+    template <class T>
+    struct HasExpr {
+      template <class U> static char test(typename AsExpr<U>::type*);
+      template <class U> static long test(...);
+      static const bool value = sizeof(test<T>(nullptr)) == sizeof(char);
+    };
+
+    template <bool Enabled, class Op, class L, class R>
+    struct BinaryResultImpl {};
+
+    template <class Op, class L, class R>
+    struct BinaryResultImpl<true, Op, L, R> {
+      typedef BinaryExpr<Op, typename AsExpr<L>::type, typename AsExpr<R>::type> type;
+    };
+
+    /*
+     * Resulting node type of Op applied to L and R. Only defined when both can
+     * take part in an expression and at least one is matrix shaped, so the
+     * operators below never hijack scalar or unrelated arithmetic.
+     */
+    template <class Op, class L, class R>
+    struct BinaryResult : BinaryResultImpl<
+      HasExpr<L>::value && HasExpr<R>::value &&
+      (!std::is_arithmetic<L>::value || !std::is_arithmetic<R>::value),
+      Op, L, R> {};
+
+    template <class Op, class L, class R>
+    BinaryExpr<Op, typename AsExpr<L>::type, typename AsExpr<R>::type> make(const L& l, const R& r) {
+      return BinaryExpr<Op, typename AsExpr<L>::type, typename AsExpr<R>::type>(AsExpr<L>::wrap(l), AsExpr<R>::wrap(r));
+    }
+
+    /*
+     * Convert a computed value to the element type T of a destination. Integer
+     * destinations clamp to their range instead of wrapping, so narrow
+     * population counts saturate.
+     */
+    template <class T, class V>
+    typename std::enable_if<!std::is_integral<T>::value || std::is_same<T, bool>::value, T>::type saturate(V v) {
+      return (T) v;
+    }
+
+    template <class T, class V>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && std::is_floating_point<V>::value, T>::type saturate(V v) {
+      if (v <= (V) std::numeric_limits<T>::lowest())
+        return std::numeric_limits<T>::lowest();
+      if (v >= (V) std::numeric_limits<T>::max())
+        return std::numeric_limits<T>::max();
+      return (T) v;
+    }
+
+    template <class T, class V>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && std::is_integral<V>::value, T>::type saturate(V v) {
+      if (v < 0 && (!std::is_signed<T>::value || (std::intmax_t) v < (std::intmax_t) std::numeric_limits<T>::lowest()))
+        return std::numeric_limits<T>::lowest();
+      if (v > 0 && (std::uintmax_t) v > (std::uintmax_t) std::numeric_limits<T>::max())
+        return std::numeric_limits<T>::max();
+      return (T) v;
+    }
+
+    /* Accumulator type used when reducing values of type V */
+    template <class V>
+    struct SumType {
+      typedef typename std::conditional<std::is_floating_point<V>::value, double, std::int64_t>::type type;
+    };
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::Plus, L, R>::type operator+(const L& l, const R& r) {
+    return expr::make<expr::Plus>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::Minus, L, R>::type operator-(const L& l, const R& r) {
+    return expr::make<expr::Minus>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::Multiply, L, R>::type operator*(const L& l, const R& r) {
+    return expr::make<expr::Multiply>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::Min, L, R>::type min(const L& l, const R& r) {
+    return expr::make<expr::Min>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::Max, L, R>::type max(const L& l, const R& r) {
+    return expr::make<expr::Max>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::Less, L, R>::type operator<(const L& l, const R& r) {
+    return expr::make<expr::Less>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::Greater, L, R>::type operator>(const L& l, const R& r) {
+    return expr::make<expr::Greater>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::LessEqual, L, R>::type operator<=(const L& l, const R& r) {
+    return expr::make<expr::LessEqual>(l, r);
+  }
+
+  template <class L, class R>
+  typename expr::BinaryResult<expr::GreaterEqual, L, R>::type operator>=(const L& l, const R& r) {
+    return expr::make<expr::GreaterEqual>(l, r);
+  }
+
+  /*
+   * dest = e, in one pass. dest must already have the dimensions of e. Integer
+   * results saturate to the range of the destination's element type.
+   */
+  template <class T, class E>
+  void assign(Matrix<T>& dest, const E& e) {
+    typename expr::AsExpr<E>::type node = expr::AsExpr<E>::wrap(e);
+    for (unsigned int r = 0; r < dest.numberRows(); r++) {
+      T* out = dest.rowPtr(r);
+      for (unsigned int c = 0; c < dest.numberCols(); c++) {
+        out[c] = expr::saturate<T>(node.at(r, c));
+      }
+    }
+  }
+
+  /*
+   * dest += e, in one pass. e may read from dest. Saturates like assign().
+   */
+  template <class T, class E>
+  void addAssign(Matrix<T>& dest, const E& e) {
+    typename expr::AsExpr<E>::type node = expr::AsExpr<E>::wrap(e);
+    for (unsigned int r = 0; r < dest.numberRows(); r++) {
+      T* out = dest.rowPtr(r);
+      for (unsigned int c = 0; c < dest.numberCols(); c++) {
+        out[c] = expr::saturate<T>(out[c] + node.at(r, c));
+      }
+    }
+  }
+
+  /*
+   * Sum of all elements of e, accumulated in 64 bits
+   */
+  template <class E>
+  typename expr::SumType<typename expr::AsExpr<E>::type::value_type>::type sum(const E& e) {
+    typename expr::AsExpr<E>::type node = expr::AsExpr<E>::wrap(e);
+    typename expr::SumType<typename expr::AsExpr<E>::type::value_type>::type total = 0;
+    for (unsigned int r = 0; r < node.numberRows(); r++) {
+      for (unsigned int c = 0; c < node.numberCols(); c++) {
+        total += node.at(r, c);
+      }
+    }
+    return total;
+  }
+
+  /*
+   * Number of elements of e that are non-zero (or true)
+   */
+  template <class E>
+  std::size_t count(const E& e) {
+    typename expr::AsExpr<E>::type node = expr::AsExpr<E>::wrap(e);
+    std::size_t total = 0;
+    for (unsigned int r = 0; r < node.numberRows(); r++) {
+      for (unsigned int c = 0; c < node.numberCols(); c++) {
+        total += node.at(r, c) ? 1 : 0;
+      }
+    }
+    return total;
+  }
+
+  /*
+   * Largest element of e, or the lowest representable value if e is empty
+   */
+  template <class E>
+  typename expr::AsExpr<E>::type::value_type maxOf(const E& e) {
+    typedef typename expr::AsExpr<E>::type::value_type V;
+    typename expr::AsExpr<E>::type node = expr::AsExpr<E>::wrap(e);
+    V best = std::numeric_limits<V>::lowest();
+    for (unsigned int r = 0; r < node.numberRows(); r++) {
+      for (unsigned int c = 0; c < node.numberCols(); c++) {
+        V value = node.at(r, c);
+        if (best < value)
+          best = value;
+      }
+    }
+    return best;
+  }
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef MARS_MATRIXFILE_H
+#define MARS_MATRIXFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace MARS {
+
+  /*
+   * MatrixAccess - expected access pattern of a file-backed Matrix, passed on
+   * to the kernel so it can tune read-ahead and paging
+   */
+  enum MatrixAccess {
+    MATRIX_ACCESS_NORMAL,     // No particular pattern
+    MATRIX_ACCESS_SEQUENTIAL, // Read front to back, e.g. whole-grid passes
+    MATRIX_ACCESS_RANDOM,     // Scattered reads, e.g. searches around a point
+    MATRIX_ACCESS_WILLNEED    // Page the whole matrix in ahead of use
+  };
+
+  namespace detail {
+    /*
+     * Element type codes stored in matrix files, so that a file is never
+     * reinterpreted as a different type. 0 means the type cannot be stored.
+     */
+    template <class T> struct MatrixDType { static const std::uint32_t code = 0; };
+    template <> struct MatrixDType<bool> { static const std::uint32_t code = 1; };
+    template <> struct MatrixDType<std::int8_t> { static const std::uint32_t code = 2; };
+    template <> struct MatrixDType<std::uint8_t> { static const std::uint32_t code = 3; };
+    template <> struct MatrixDType<std::int16_t> { static const std::uint32_t code = 4; };
+    template <> struct MatrixDType<std::uint16_t> { static const std::uint32_t code = 5; };
+    template <> struct MatrixDType<std::int32_t> { static const std::uint32_t code = 6; };
+    template <> struct MatrixDType<std::uint32_t> { static const std::uint32_t code = 7; };
+    template <> struct MatrixDType<std::int64_t> { static const std::uint32_t code = 8; };
+    template <> struct MatrixDType<std::uint64_t> { static const std::uint32_t code = 9; };
+    template <> struct MatrixDType<float> { static const std::uint32_t code = 10; };
+    template <> struct MatrixDType<double> { static const std::uint32_t code = 11; };
+
+    /*
+     * On-disk header at the start of every matrix file. The elements follow
+     * at data_offset, which is a multiple of the page size, row by row with
+     * `stride` elements between the starts of consecutive rows.
+     */
+    struct MatrixFileHeader {
+      char magic[8]; // MATRIX_FILE_MAGIC
+      std::uint32_t version; // MATRIX_FILE_VERSION
+      std::uint32_t dtype; // MatrixDType code of the elements
+      std::uint32_t element_size; // sizeof an element, in bytes
+      std::uint32_t rows;
+      std::uint32_t cols;
+      std::uint32_t stride;
+      std::uint64_t data_offset; // Offset of the first element from the start of the file, in bytes
+    };
+
+    /*
+     * A mapped matrix file. data points at the first element.
+     */
+    struct MatrixMapping {
+      void* base; // Start of the mapping, at the header
+      std::size_t bytes; // Length of the mapping
+      void* data;
+    };
+
+    /*
+     * Create (or truncate) a matrix file described by header, and map it. The
+     * data_offset field is filled in. Elements are zero until written, and are
+     * only backed by disk blocks once touched.
+     * Throws std::runtime_error on failure.
+     */
+    MatrixMapping createMatrixFile(const std::string& path, MatrixFileHeader& header);
+
+    /*
+     * Map an existing matrix file, whose header must match dtype and
+     * element_size of expected. The rows, cols and stride fields of expected
+     * are filled in from the file.
+     * Throws std::runtime_error if the file is missing, truncated or of another type.
+     */
+    MatrixMapping openMatrixFile(const std::string& path, MatrixFileHeader& expected);
+
+    /*
+     * Read just the header of a matrix file. Returns false if the file is
+     * missing or is not a matrix file.
+     */
+    bool readMatrixFileHeader(const std::string& path, MatrixFileHeader& header);
+
+    /* Write back dirty pages of a mapping to disk */
+    void syncMatrixFile(const MatrixMapping& mapping);
+
+    void adviseMatrixFile(const MatrixMapping& mapping, MatrixAccess access);
+
+    void unmapMatrixFile(const MatrixMapping& mapping);
+  }
+}
+
+#endif
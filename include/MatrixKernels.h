@@ -0,0 +1,76 @@
+#ifndef MARS_MATRIXKERNELS_H
+#define MARS_MATRIXKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Matrix.h"
+#include "MatrixView.h"
+
+namespace MARS {
+  /*
+   * MatrixKernels - vectorized whole-matrix arithmetic and reductions
+   *
+   * Each kernel walks the matrix row by row, so padded and sliced storage is
+   * handled transparently. On x86 an SSE2 path is always available and an AVX2
+   * path is picked at runtime when the CPU supports it; elsewhere the scalar
+   * fallback is used. Operands must have matching dimensions.
+   *
+   * The 8 and 16 bit unsigned overloads are for narrow population counts.
+   * Their additions saturate at the top of the range instead of wrapping.
+   */
+  class MatrixKernels {
+  public:
+    /* out = a + b */
+    static void add(const MatrixView<int>& a, const MatrixView<int>& b, Matrix<int>& out);
+    static void add(const MatrixView<float>& a, const MatrixView<float>& b, Matrix<float>& out);
+    static void add(const MatrixView<std::uint8_t>& a, const MatrixView<std::uint8_t>& b, Matrix<std::uint8_t>& out);
+    static void add(const MatrixView<std::uint16_t>& a, const MatrixView<std::uint16_t>& b, Matrix<std::uint16_t>& out);
+
+    /* dest += src */
+    static void addInto(Matrix<int>& dest, const MatrixView<int>& src);
+    static void addInto(Matrix<float>& dest, const MatrixView<float>& src);
+    static void addInto(Matrix<std::uint8_t>& dest, const MatrixView<std::uint8_t>& src);
+    static void addInto(Matrix<std::uint16_t>& dest, const MatrixView<std::uint16_t>& src);
+
+    /* Sum of all elements, accumulated in 64 bits */
+    static std::int64_t sum(const MatrixView<int>& m);
+    static double sum(const MatrixView<float>& m);
+    static std::int64_t sum(const MatrixView<std::uint8_t>& m);
+    static std::int64_t sum(const MatrixView<std::uint16_t>& m);
+
+    /* Sum of the squares of all elements, accumulated in 64 bits */
+    static std::int64_t sumOfSquares(const MatrixView<int>& m);
+    static double sumOfSquares(const MatrixView<float>& m);
+    static std::int64_t sumOfSquares(const MatrixView<std::uint8_t>& m);
+    static std::int64_t sumOfSquares(const MatrixView<std::uint16_t>& m);
+
+    /* Largest element, or the lowest representable value for an empty matrix */
+    static int max(const MatrixView<int>& m);
+    static float max(const MatrixView<float>& m);
+    static std::uint8_t max(const MatrixView<std::uint8_t>& m);
+    static std::uint16_t max(const MatrixView<std::uint16_t>& m);
+
+    /* Number of elements strictly greater than threshold */
+    static std::size_t countAbove(const MatrixView<int>& m, int threshold);
+    static std::size_t countAbove(const MatrixView<float>& m, float threshold);
+
+    /* Clamp every element into [lo, hi] */
+    static void clamp(Matrix<int>& m, int lo, int hi);
+    static void clamp(Matrix<float>& m, float lo, float hi);
+
+    /* dest &= src, dest |= src, dest ^= src and dest &= ~src, over 64 bit words */
+    static void andInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src);
+    static void orInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src);
+    static void xorInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src);
+    static void andNotInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src);
+
+    /* Number of set bits over 64 bit words */
+    static std::int64_t popcount(const MatrixView<std::uint64_t>& m);
+
+    /* Whether the AVX2 paths are in use on this machine */
+    static bool usingAVX2();
+  };
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef MARS_MATRIXLAYOUT_H
+#define MARS_MATRIXLAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MARS {
+  /*
+   * Matrix layout policies
+   *
+   * A layout maps a (row, col) coordinate to an offset into a Matrix's storage.
+   * It is constructed from the dimensions and a column multiple that every row
+   * (or tile row) is padded out to, and provides:
+   *   std::size_t size() const              - number of elements to allocate
+   *   std::size_t index(r, c) const         - offset of element (r, c)
+   *   bool operator==(const Layout&) const  - whether two layouts share a shape
+   *   static const bool row_major           - whether rows are contiguous, so that
+   *                                           views, row pointers and the SIMD kernels apply
+   */
+
+  /*
+   * RowMajorLayout - rows are stored back to back, `stride()` elements apart
+   */
+  class RowMajorLayout {
+  private:
+    unsigned int num_rows;
+    unsigned int row_stride;
+  public:
+    static const bool row_major = true;
+
+    RowMajorLayout(unsigned int rows, unsigned int cols, unsigned int col_multiple):
+      num_rows(rows),
+      row_stride((cols + col_multiple - 1) / col_multiple * col_multiple)
+    {
+    }
+
+    std::size_t size() const {
+      return (std::size_t) num_rows * row_stride;
+    }
+
+    std::size_t index(unsigned int r, unsigned int c) const {
+      return (std::size_t) r * row_stride + c;
+    }
+
+    unsigned int stride() const {
+      return row_stride;
+    }
+
+    bool operator==(const RowMajorLayout& other) const {
+      return num_rows == other.num_rows && row_stride == other.row_stride;
+    }
+  };
+
+  /*
+   * TiledLayout - the matrix is cut into Tile x Tile blocks, stored in row-major
+   * order of blocks, each block itself row-major. A cell and its 2D neighbours
+   * usually share a block, so local searches touch far fewer cache lines.
+   * Tile must be a power of two. Padding only applies at the right and bottom edges.
+   */
+  template <unsigned int Tile>
+  class TiledLayout {
+    static_assert(Tile != 0 && (Tile & (Tile - 1)) == 0, "Tile must be a power of two");
+  private:
+    unsigned int tile_rows; // Number of rows of tiles
+    unsigned int tile_cols; // Number of tiles in each row of tiles
+  public:
+    static const bool row_major = false;
+
+    TiledLayout(unsigned int rows, unsigned int cols, unsigned int):
+      tile_rows((rows + Tile - 1) / Tile),
+      tile_cols((cols + Tile - 1) / Tile)
+    {
+    }
+
+    std::size_t size() const {
+      return (std::size_t) tile_rows * tile_cols * Tile * Tile;
+    }
+
+    std::size_t index(unsigned int r, unsigned int c) const {
+      std::size_t tile = (std::size_t) (r / Tile) * tile_cols + c / Tile;
+      return tile * Tile * Tile + (r % Tile) * Tile + c % Tile;
+    }
+
+    bool operator==(const TiledLayout& other) const {
+      return tile_rows == other.tile_rows && tile_cols == other.tile_cols;
+    }
+  };
+
+  /*
+   * MortonLayout - elements are stored along a Z-order curve, interleaving the
+   * bits of the row and column. Each dimension is padded up to a power of two;
+   * for non-square matrices the extra high bits of the longer dimension select
+   * between consecutive square Z-order blocks, so no further space is wasted.
+   */
+  class MortonLayout {
+  private:
+    unsigned int row_bits; // log2 of the padded number of rows
+    unsigned int col_bits; // log2 of the padded number of columns
+    unsigned int shared_bits; // Number of low bits of each coordinate that are interleaved
+
+    static unsigned int bitsFor(unsigned int n) {
+      unsigned int bits = 0;
+      while (((std::uint64_t) 1 << bits) < n)
+        bits++;
+      return bits;
+    }
+
+    /* Spread the low 32 bits of x out to the even bits of the result */
+    static std::uint64_t spread(std::uint64_t x) {
+      x &= 0xFFFFFFFFull;
+      x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+      x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+      x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+      x = (x | (x << 2)) & 0x3333333333333333ull;
+      x = (x | (x << 1)) & 0x5555555555555555ull;
+      return x;
+    }
+
+  public:
+    static const bool row_major = false;
+
+    MortonLayout(unsigned int rows, unsigned int cols, unsigned int):
+      row_bits(bitsFor(rows)),
+      col_bits(bitsFor(cols)),
+      shared_bits(row_bits < col_bits ? row_bits : col_bits)
+    {
+    }
+
+    std::size_t size() const {
+      return (std::size_t) 1 << (row_bits + col_bits);
+    }
+
+    std::size_t index(unsigned int r, unsigned int c) const {
+      std::uint64_t mask = ((std::uint64_t) 1 << shared_bits) - 1;
+      std::uint64_t low = (spread(r & mask) << 1) | spread(c & mask);
+      // At most one of these is non-zero, as the shorter dimension has no bits above shared_bits
+      std::uint64_t high = (std::uint64_t) (r >> shared_bits) | (std::uint64_t) (c >> shared_bits);
+      return (std::size_t) (low | (high << (2 * shared_bits)));
+    }
+
+    bool operator==(const MortonLayout& other) const {
+      return row_bits == other.row_bits && col_bits == other.col_bits;
+    }
+  };
+}
+
+#endif
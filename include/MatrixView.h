@@ -0,0 +1,90 @@
+#ifndef MARS_MATRIXVIEW_H
+#define MARS_MATRIXVIEW_H
+
+#include <cstddef>
+
+namespace MARS {
+  /*
+   * MatrixView - a read-only, non-owning window onto 2D data laid out in rows
+   *
+   * A view is only valid as long as the storage it was taken from is alive and
+   * has not been reallocated. Copying a view never copies the elements.
+   */
+  template <class T>
+  class MatrixView {
+  private:
+    const T* data; // First element of the window
+    unsigned int num_rows; // Number of rows
+    unsigned int num_cols; // Number of columns
+    unsigned int row_stride; // Number of elements between the starts of consecutive rows
+
+  public:
+
+    /*
+     * Constructor
+     * Takes in a pointer to the first element, the dimensions, and the row stride in elements
+     */
+    MatrixView(const T* data, unsigned int rows, unsigned int cols, unsigned int stride):
+      data(data),
+      num_rows(rows),
+      num_cols(cols),
+      row_stride(stride)
+    {
+    }
+
+    /**
+     * Access const reference to data at location
+     */
+    const T& at(unsigned int r, unsigned int c) const {
+      #ifdef FLAG_MATRIX_BOUNDS_CHECKING
+      if (r >= num_rows)
+        throw -1;
+      if (c >= num_cols)
+        throw -1;
+      #endif
+      return data[(std::size_t) r * row_stride + c];
+    }
+
+    const T* ptr() const {
+      return data;
+    }
+
+    const T* rowPtr(unsigned int r) const {
+      return data + (std::size_t) r * row_stride;
+    }
+
+    /**
+     * View of a single row, as a 1 x numberCols() matrix
+     */
+    MatrixView row(unsigned int r) const {
+      return MatrixView(rowPtr(r), 1, num_cols, row_stride);
+    }
+
+    /**
+     * View of the rectangle with top left corner (r, c) and the given dimensions
+     */
+    MatrixView subView(unsigned int r, unsigned int c, unsigned int rows, unsigned int cols) const {
+      #ifdef FLAG_MATRIX_BOUNDS_CHECKING
+      if (r + rows > num_rows)
+        throw -1;
+      if (c + cols > num_cols)
+        throw -1;
+      #endif
+      return MatrixView(rowPtr(r) + c, rows, cols, row_stride);
+    }
+
+    unsigned int numberRows() const {
+      return num_rows;
+    }
+
+    unsigned int numberCols() const {
+      return num_cols;
+    }
+
+    unsigned int stride() const {
+      return row_stride;
+    }
+  };
+}
+
+#endif
@@ -3,7 +3,10 @@
 #include "Coord.h"
 #include "Terrain.h"
 #include "BitMatrix.h"
+#include "CoverageStencil.h"
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace MARS {
   /**
@@ -14,8 +17,8 @@ namespace MARS {
     int in_service; 
     int capacity;
     double serviceable_distance;
-    std::unordered_map<Coord, double> serviceable_area; 
-    std::unordered_map<Coord, int> serviced_map;
+    std::shared_ptr<const CoverageStencil> serviceable_area; // Shared with other plants at the same spot
+    std::vector<int> serviced_map; // Number served at each cell of serviceable_area, by position
   public:
     Coord location;        
     
@@ -27,18 +30,20 @@ namespace MARS {
       double serve_dist,
       int x,
       int y,
-      Terrain &terrain
+      const Terrain &terrain
     );
 
     /**
      * Generate the plant's serviceable area given a terrain, location, and serviceable distance.
+     * Distances are exact shortest path weights. The plant's own cell is not included.
+     * Areas are looked up in CoverageCache::shared() before being searched for.
      */
-    std::unordered_map<Coord,double> generateServiceableArea(const Terrain& terrain, const Coord& plant_loc, double serve_dist);
+    std::shared_ptr<const CoverageStencil> generateServiceableArea(const Terrain& terrain, const Coord& plant_loc, double serve_dist);
 
     /**
      * Initialize the serviced map using the plant's serviceable area.
      */
-    std::unordered_map<Coord, int> initializeServicedMap(std::unordered_map<Coord, double> serviceable_area);
+    std::vector<int> initializeServicedMap(const CoverageStencil& serviceable_area);
 
     /**
      * Check if coordinate is serviceable by plant
@@ -67,14 +72,14 @@ namespace MARS {
     int remainingCapacity() const;
 
     /**
-     * Get a copy of the serviceable area
+     * Get the serviceable area, mapping each coordinate to its weighted distance
      */
-    std::unordered_map<Coord, double> serviceableArea() const;
+    const CoverageStencil& serviceableArea() const;
 
     /**
-     * Get a copy of the serviced map
+     * Get the number served at each cell of the serviceable area, in the same order
      */
-    std::unordered_map<Coord, int> servicedMap() const;
+    const std::vector<int>& servicedMap() const;
 
     bool operator==(const Plant& other) const {
       return location == other.location;
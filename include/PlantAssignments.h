@@ -0,0 +1,97 @@
+#ifndef MARS_PLANTASSIGNMENTS_H
+#define MARS_PLANTASSIGNMENTS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "PlantPool.h"
+#include "SharedMatrix.h"
+
+namespace MARS {
+  /**
+   * PlantAssignments - number of people each plant serves at each cell
+   *
+   * Most cells are served by at most one plant, so every cell holds one
+   * (plant, count) entry inline, 16 bytes in all. Cells served by more
+   * plants keep the rest in an overflow list, shared by index. Entries are
+   * kept once made, even when their count drops to zero.
+   *
+   * Copies share both the cells and the overflow lists, and clone them on
+   * the first write, like SharedMatrix.
+   */
+  class PlantAssignments {
+  public:
+    struct Entry {
+      PlantHandle plant;
+      std::int32_t count;
+
+      Entry(): count(0) {}
+      Entry(PlantHandle plant, std::int32_t count): plant(plant), count(count) {}
+    };
+
+  private:
+    struct Cell {
+      Entry first; // Null plant if the cell has no entries
+      std::uint32_t overflow; // Overflow list number + 1, or 0 if none
+
+      Cell(): overflow(0) {}
+    };
+
+    typedef std::vector<std::vector<Entry>> OverflowLists;
+
+    SharedMatrix<Cell> cells;
+    std::shared_ptr<OverflowLists> overflow;
+
+    OverflowLists& writeOverflow();
+
+  public:
+
+    /**
+     * Constructor
+     * Takes in the number of rows and columns of the grid
+     */
+    PlantAssignments(int rows, int cols);
+
+    /**
+     * Number of people plant serves at (x, y), 0 if it serves none there
+     */
+    int count(int x, int y, PlantHandle plant) const;
+
+    /**
+     * Add delta to the number of people plant serves at (x, y)
+     */
+    void add(int x, int y, PlantHandle plant, int delta);
+
+    /**
+     * Call f(plant, count) for every entry at (x, y), in the order they were made
+     */
+    template <class F>
+    void forEachAt(int x, int y, F f) const {
+      const Cell& cell = cells.at(x, y);
+      if (cell.first.plant.isNull())
+        return;
+      f(cell.first.plant, (int) cell.first.count);
+      if (cell.overflow == 0)
+        return;
+      for (const Entry& entry : (*overflow)[cell.overflow - 1])
+        f(entry.plant, (int) entry.count);
+    }
+
+    unsigned int numberRows() const {
+      return cells.numberRows();
+    }
+
+    unsigned int numberCols() const {
+      return cells.numberCols();
+    }
+
+    /**
+     * Memory held, in bytes
+     */
+    std::size_t memoryUsage() const;
+  };
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef MARS_PLANTPOOL_H
+#define MARS_PLANTPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Coord.h"
+#include "CoverageStencil.h"
+#include "Terrain.h"
+
+namespace MARS {
+  /**
+   * PlantHandle - refers to a plant in a PlantPool
+   *
+   * The id is the plant's slot in the pool. The generation tells apart
+   * plants that have held the same slot, so a handle to a removed plant is
+   * never taken for its successor. Default constructed handles are null.
+   */
+  struct PlantHandle {
+    std::uint32_t id;
+    std::uint32_t generation; // 0 for null handles
+
+    PlantHandle(): id(0), generation(0) {}
+    PlantHandle(std::uint32_t id, std::uint32_t generation): id(id), generation(generation) {}
+
+    bool isNull() const {
+      return generation == 0;
+    }
+
+    bool operator==(const PlantHandle& other) const {
+      return id == other.id && generation == other.generation;
+    }
+
+    bool operator!=(const PlantHandle& other) const {
+      return !(*this == other);
+    }
+  };
+
+  /**
+   * PlantPool - plants stored as parallel arrays, one slot per plant
+   *
+   * Each field lives in its own array indexed by plant id, so loops over
+   * plants touch only the fields they read, and the state is plain data.
+   * The served counts of every plant share one array, each plant owning a
+   * run of it parallel to its coverage stencil.
+   *
+   * Handles are checked on every access, and std::out_of_range is thrown
+   * for plants that have been removed. Ids of removed plants are reused.
+   */
+  class PlantPool {
+  private:
+    std::vector<std::uint32_t> generations; // Current generation of each slot, odd while the slot is live
+    std::vector<Coord> locations;
+    std::vector<int> capacities;
+    std::vector<int> in_service; // Number of people each plant serves
+    std::vector<double> serve_dists;
+    std::vector<std::shared_ptr<const CoverageStencil>> coverage;
+    std::vector<std::uint32_t> coverage_offsets; // Start of each plant's run of served
+    std::vector<std::uint32_t> run_lengths; // Length of each slot's run of served, kept for reuse
+    std::vector<int> served; // Number served at each covered cell, by plant then stencil position
+    std::vector<std::uint32_t> free_ids;
+    std::uint32_t number_live;
+
+    std::uint32_t index(PlantHandle plant) const;
+
+    /* Position of c in the plant's coverage. Throws std::out_of_range if not covered. */
+    std::size_t positionOf(std::uint32_t id, const Coord& c) const;
+
+  public:
+    PlantPool();
+
+    /**
+     * Build a plant, taking its serviceable area from CoverageCache::shared()
+     */
+    PlantHandle create(const Coord& location, int capacity, double serve_dist, const Terrain& terrain);
+
+    /**
+     * Remove a plant. Its handles become invalid, and its id may be reused.
+     */
+    void remove(PlantHandle plant);
+
+    /**
+     * Whether the handle refers to a plant in the pool
+     */
+    bool contains(PlantHandle plant) const;
+
+    /* Number of plants in the pool */
+    std::size_t size() const;
+
+    /* Number of slots, including those of removed plants. Ids are below this. */
+    std::size_t numberSlots() const;
+
+    /**
+     * Handle of the plant in slot id, or a null handle if the slot is free
+     */
+    PlantHandle handleAt(std::uint32_t id) const;
+
+    /**
+     * Call f with the handle of every plant, in id order
+     */
+    template <class F>
+    void forEach(F f) const {
+      for (std::uint32_t id = 0; id < generations.size(); id++) {
+        if (generations[id] & 1)
+          f(PlantHandle(id, generations[id]));
+      }
+    }
+
+    const Coord& location(PlantHandle plant) const;
+    int capacity(PlantHandle plant) const;
+    int inService(PlantHandle plant) const;
+    int remainingCapacity(PlantHandle plant) const;
+    double serveDistance(PlantHandle plant) const;
+
+    /**
+     * Remaining capacity by id, without checking the handle, for hot loops
+     * over plants known to be live
+     */
+    int remainingCapacityOf(std::uint32_t id) const {
+      return capacities[id] - in_service[id];
+    }
+
+    /**
+     * Get the serviceable area, mapping each coordinate to its weighted distance
+     */
+    const CoverageStencil& serviceableArea(PlantHandle plant) const;
+
+    bool isServiceableCoord(PlantHandle plant, const Coord& c) const;
+
+    /**
+     * Get distance to coord. Throws std::out_of_range if not serviceable.
+     */
+    double distanceToCoord(PlantHandle plant, const Coord& c) const;
+
+    /**
+     * Number of people the plant services at a coordinate. Throws
+     * std::out_of_range if not serviceable.
+     */
+    int numberServicedAtCoord(PlantHandle plant, const Coord& c) const;
+
+    /**
+     * Changes the size of population the plant services at a given location
+     */
+    void changeServicedPop(PlantHandle plant, const Coord& c, int pop);
+
+    /*
+     * The arrays themselves, indexed by plant id, e.g. for saving the state.
+     * Entries of free slots are left over from their last plant.
+     */
+    const std::vector<Coord>& locationArray() const { return locations; }
+    const std::vector<int>& capacityArray() const { return capacities; }
+    const std::vector<int>& inServiceArray() const { return in_service; }
+    const std::vector<std::uint32_t>& coverageOffsetArray() const { return coverage_offsets; }
+    const std::vector<int>& servedArray() const { return served; }
+  };
+}
+
+namespace std {
+  /*
+   * Hash a PlantHandle. Ids are dense, so they are already well spread.
+   */
+  template <>
+  struct hash<MARS::PlantHandle> {
+    std::size_t operator()(const MARS::PlantHandle& plant) const {
+      return plant.id;
+    }
+  };
+}
+
+#endif
@@ -5,13 +5,62 @@
 #ifndef MARS_POPULATIONGEN_H
 #define MARS_POPULATIONGEN_H
 
+#include <algorithm>
+#include <cmath>
 #include <ctime>
 #include "Matrix.h"
+#include "MatrixExpr.h"
 #include "PerlinNoise.h"
 #include "Terrain.h"
 
+#define CURR_THRESH_INC 0.02
+#define POP_MAX 50
+
 namespace MARS {
 
+  /*
+   * PopulationGrowth - lazy expression for the population to be added to each
+   * cell, given an expression for the current population. Cells on water or
+   * mountains, or above the noise threshold, grow by 0.
+   */
+  template <class E>
+  class PopulationGrowth : public MatrixExprTag {
+  private:
+    const siv::PerlinNoise* perlin;
+    const Terrain* terrain;
+    double curr_thresh;
+    double row_scale; // log2 of the number of rows, hoisted out of the per cell loop
+    double col_scale; // log2 of the number of columns
+    E pop;
+  public:
+    typedef int value_type;
+
+    PopulationGrowth(const siv::PerlinNoise& perlin, const Terrain& terrain, double curr_thresh, const E& pop):
+      perlin(&perlin),
+      terrain(&terrain),
+      curr_thresh(curr_thresh),
+      row_scale(std::log2(pop.numberRows())),
+      col_scale(std::log2(pop.numberCols())),
+      pop(pop)
+    {
+    }
+
+    unsigned int numberRows() const { return pop.numberRows(); }
+    unsigned int numberCols() const { return pop.numberCols(); }
+
+    int at(unsigned int i, unsigned int j) const {
+      double weight = terrain->weightAtXY(i, j);
+      if (weight == WATER_WEIGHT or weight == MOUNTAIN_WEIGHT)
+        return 0;
+      double noise = perlin->noise0_1(i/row_scale, j/col_scale);
+      if (noise > curr_thresh)
+        return 0;
+      int target = (int) (POP_MAX*(curr_thresh-noise));
+      target = std::min(POP_MAX, target);
+      return target - pop.at(i, j);
+    }
+  };
+
   class PopulationGen {
   private:
     siv::PerlinNoise perlin; // instance of Perlin Noise generator
@@ -28,10 +77,31 @@ namespace MARS {
     /* Takes current population matrix as input
      * Returns matrix of new population to be added
      */
-    Matrix<int> generate(Matrix<int> popMatrix, Terrain terrain, int t);
+    Matrix<int> generate(const Matrix<int>& popMatrix, const Terrain& terrain, int t);
+
+    /* Takes current population matrix as input, and writes the new population
+     * to be added into newMatrix, which must have the same dimensions.
+     * Returns false, leaving newMatrix untouched, if no population is generated at time t.
+     */
+    bool generate(const MatrixView<int>& popMatrix, const Terrain& terrain, int t, Matrix<int>& newMatrix);
+
+    /*
+     * Moves the generator on to time t. Returns whether population is
+     * generated at t, in which case growth() describes it.
+     */
+    bool advance(int t);
+
+    /*
+     * Lazy expression for the new population to be added, given any matrix
+     * expression for the current population. Nothing is computed until the
+     * result is assigned or reduced, so it can be fused straight into the
+     * destination, e.g. addAssign(unserviced, gen.growth(serviced + unserviced, terrain)).
+     */
+    template <class E>
+    PopulationGrowth<typename expr::AsExpr<E>::type> growth(const E& popMatrix, const Terrain& terrain) const {
+      return PopulationGrowth<typename expr::AsExpr<E>::type>(perlin, terrain, curr_thresh, expr::AsExpr<E>::wrap(popMatrix));
+    }
   };
 }
 
 #endif
-
-
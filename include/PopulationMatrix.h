@@ -1,13 +1,70 @@
 #ifndef MARS_POPULATIONMATRIX_H
 #define MARS_POPULATIONMATRIX_H
 
+#include <cstdint>
 #include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
-#include "Plant.h"
+#include "PlantAssignments.h"
+#include "PlantPool.h"
 #include "Matrix.h"
+#include "MatrixExpr.h"
+#include "CoordMap.h"
+#include "MatrixKernels.h"
+#include "SharedMatrix.h"
+#include "SparseTileMatrix.h"
+
+/*
+ * Element type of the per-cell population layers. Cells never hold more than
+ * POP_MAX people, so a narrow type saves memory and bandwidth on every grid
+ * pass. May be std::uint8_t, std::uint16_t or int; arithmetic on the narrow
+ * types saturates.
+ */
+#ifndef MARS_POP_TYPE
+#define MARS_POP_TYPE std::uint16_t
+#endif
 
 namespace MARS {
 
+  typedef MARS_POP_TYPE PopCount;
+
+  /*
+   * PopulationLayer - expression leaf reading one population layer, whichever
+   * way it is stored
+   */
+  class PopulationLayer : public MatrixExprTag {
+  private:
+    const PopCount* data; // Dense storage, or null if sparse
+    const SparseTileMatrix<PopCount>* sparse;
+    unsigned int row_stride;
+    unsigned int num_rows;
+    unsigned int num_cols;
+  public:
+    typedef PopCount value_type;
+
+    explicit PopulationLayer(const Matrix<PopCount>& m):
+      data(m.rowPtr(0)), sparse(nullptr), row_stride(m.stride()), num_rows(m.numberRows()), num_cols(m.numberCols()) {}
+    explicit PopulationLayer(const SparseTileMatrix<PopCount>& m):
+      data(nullptr), sparse(&m), row_stride(0), num_rows(m.numberRows()), num_cols(m.numberCols()) {}
+
+    unsigned int numberRows() const { return num_rows; }
+    unsigned int numberCols() const { return num_cols; }
+    PopCount at(unsigned int r, unsigned int c) const {
+      return data != nullptr ? data[(std::size_t) r * row_stride + c] : sparse->at(r, c);
+    }
+  };
+
+  /*
+   * People a plant serves at a coordinate, and its distance to it
+   */
+  struct PlantServing {
+    PlantHandle plant;
+    int count;
+    double distance;
+  };
+
   class PopulationMatrix {
   private:
     /*
@@ -15,16 +72,54 @@ namespace MARS {
      * unservicedPopMatrix: matrix containining unserviced populations
      * plantAssignMatrix: assignment of plants to populations
      *
+     * In sparse mode the population layers live in the sparse_* tile matrices
+     * instead, and the dense ones are empty.
+     *
+     * The dense layers and the assignments are copy-on-write, so a copy of a
+     * PopulationMatrix is an O(1) snapshot until either side changes.
+     *
+     * row_totals holds the sum of each layer and of its squares for every
+     * row, and totals the same over the whole grid. Every change to the
+     * populations updates them, so totals never need a pass over the grid.
      */
-    Matrix<int> serviced_pop_matrix;
-    Matrix<int> unserviced_pop_matrix;
-    Matrix<std::unordered_map<Plant*, int>> plant_assign_matrix;
+    bool sparse;
+    SharedMatrix<PopCount> serviced_pop_matrix;
+    SharedMatrix<PopCount> unserviced_pop_matrix;
+    SparseTileMatrix<PopCount> sparse_serviced_pop;
+    SparseTileMatrix<PopCount> sparse_unserviced_pop;
+    PlantAssignments plant_assign_matrix;
+    enum { UNSERVICED_SUM, UNSERVICED_SQUARES, SERVICED_SUM, SERVICED_SQUARES, NUMBER_TOTALS };
+    SharedMatrix<std::int64_t> row_totals; // One row per grid row, one column per total
+    std::int64_t totals[NUMBER_TOTALS];
+
+    /*
+     * Totals of one row of the dense layers, or of every row, counted from
+     * scratch. counts must be zero to start with.
+     */
+    void countDenseRow(unsigned int row, std::int64_t* counts) const;
+    void countRowTotals(Matrix<std::int64_t>& counts) const;
+
+    /*
+     * Replace the row totals with a full recount, and sum them up again
+     */
+    void recountTotals();
+    void sumRowTotals();
+
+    /*
+     * Account for a cell of a layer going from before to after people
+     */
+    void changeTotals(int sum_column, unsigned int row, PopCount before, PopCount after);
   public:
     
     /*
      * Constructor
+     * If a path is given, the serviced and unserviced populations are kept in the
+     * files path.serviced.mat and path.unserviced.mat, which are overwritten.
+     * If sparse is set, the populations are instead kept in tiles that are only
+     * allocated once populated, and whole-grid passes skip the empty tiles. The
+     * two cannot be combined.
      */
-    PopulationMatrix(int dx, int dy);
+    PopulationMatrix(int dx, int dy, const std::string& path = "", bool sparse = false);
     
     /*
      * Number of people serviced at a given coordinate.
@@ -37,34 +132,143 @@ namespace MARS {
     int numberUnservicedAtCoord(const Coord& c) const;
     
     /*
-     * Number of people serviced at a given coordinate by a given plant.
+     * Number of people serviced at a given coordinate by a given plant, 0 if
+     * the plant serves none there.
      */
-    int numberServicedAtCoordByPlant(const Coord& c, Plant* p) const;
+    int numberServicedAtCoordByPlant(const Coord& c, PlantHandle p) const;
     
     /*
      * Returns a mapping of coordinates to (unserviced, {plant => serviced_by_plant})
-     * pairs within a plant's serviceable area.
+     * pairs within a plant's serviceable area, where the plants are in the given pool.
+     */
+    CoordMap<std::pair<int, std::unordered_map<PlantHandle, int>>> potentialPopForPlant(const PlantPool& plants, PlantHandle p);
+
+    /*
+     * Calls f(c, distance, unserviced, farther) for every coordinate c in a
+     * plant's serviceable area, in cell order, without building a result.
+     * distance is the plant's distance to c, and farther holds the plants
+     * farther from c that serve people there. Both populations are read
+     * before f is called, so f may change them at c. farther is only valid
+     * during the call.
      */
-    std::unordered_map<Coord, std::pair<int, std::unordered_map<Plant*, int>>> potentialPopForPlant(Plant* p);
+    template <class F>
+    void forEachPotentialPop(const PlantPool& plants, PlantHandle p, F f) const {
+      const CoverageStencil& serviceable_area = plants.serviceableArea(p);
+      std::vector<PlantServing> farther;
+      for (std::size_t i = 0; i < serviceable_area.size(); i++) {
+        Coord c = serviceable_area.coordAt(i);
+        double distance = serviceable_area.distanceAt(i);
+        farther.clear();
+        plant_assign_matrix.forEachAt(c.x, c.y, [&](PlantHandle plant, int count) {
+          double plant_distance = plants.distanceToCoord(plant, c);
+          if (plant_distance > distance)
+            farther.push_back(PlantServing{plant, count, plant_distance});
+        });
+        f(c, distance, numberUnservicedAtCoord(c), farther);
+      }
+    }
     
     /*
      * Moves a population at a given coordinate from one plant to another.
      */
-    void moveServicedPopBetweenPlants(Plant* from, Plant* to, const Coord& c, int num_pop);
+    void moveServicedPopBetweenPlants(PlantHandle from, PlantHandle to, const Coord& c, int num_pop);
     
     /*
      * Assigns an unserviced population at a given coordinate to a given plant.
      */
-    void assignUnservicedPop(Plant* p, const Coord& c, int num_pop);
+    void assignUnservicedPop(PlantHandle p, const Coord& c, int num_pop);
+
+    /*
+     * Returns a population serviced by a given plant at a given coordinate to
+     * the unserviced population.
+     */
+    void unassignServicedPop(PlantHandle p, const Coord& c, int num_pop);
      
     /*
      * Matrix-adds a new unserviced population mapping to the existing unserviced population mapping.
      */
-    void addUnservicedPop(Matrix<int>& newUnserviced);
+    void addUnservicedPop(const Matrix<PopCount>& newUnserviced);
+
+    /*
+     * As above, but takes any matrix or matrix expression, which is evaluated in
+     * the same pass as the addition. The expression may read from this
+     * PopulationMatrix. Results saturate to the range of PopCount.
+     */
+    template <class E>
+    void addUnservicedPop(const E& newUnserviced) {
+      if (sparse) {
+        sparse_unserviced_pop.addAssign(newUnserviced);
+        recountTotals();
+        return;
+      }
+      // As MARS::addAssign, counting each row's totals in the same pass
+      Matrix<PopCount>& dest = unserviced_pop_matrix.write();
+      Matrix<std::int64_t>& rows = row_totals.write();
+      typename expr::AsExpr<E>::type node = expr::AsExpr<E>::wrap(newUnserviced);
+      for (unsigned int r = 0; r < dest.numberRows(); r++) {
+        PopCount* out = dest.rowPtr(r);
+        std::int64_t sum = 0;
+        std::int64_t squares = 0;
+        for (unsigned int c = 0; c < dest.numberCols(); c++) {
+          PopCount updated = expr::saturate<PopCount>(out[c] + node.at(r, c));
+          out[c] = updated;
+          sum += updated;
+          squares += (std::int64_t) updated * updated;
+        }
+        rows.at(r, UNSERVICED_SUM) = sum;
+        rows.at(r, UNSERVICED_SQUARES) = squares;
+      }
+      sumRowTotals();
+    }
+
+    /*
+     * Lazy population layers, and their sum, never materialized unless
+     * assigned. Valid until the next write to this PopulationMatrix.
+     */
+    PopulationLayer servicedPop() const;
+    PopulationLayer unservicedPop() const;
+    BinaryExpr<expr::Plus, PopulationLayer, PopulationLayer> totalPop() const {
+      return servicedPop() + unservicedPop();
+    }
+
+    /*
+     * Sum of all unserviced populations, and of their squares, in O(1)
+     */
+    std::int64_t unservicedTotal() const;
+    std::int64_t unservicedSumOfSquares() const;
+
+    /*
+     * Sum of all serviced populations, in O(1)
+     */
+    std::int64_t servicedTotal() const;
+
+    /*
+     * Whether the running totals match a full recount of the layers. Takes a
+     * pass over the grid, so is meant for debug checks. Game::step runs it
+     * every step when built with FLAG_POPULATION_TOTALS_CHECKING.
+     */
+    bool totalsConsistent() const;
+
+    bool isSparse() const;
+
+    /*
+     * Total population at a given coordinate.
+     */
+    int numberTotalAtCoord(const Coord& c) const;
     
-    Matrix<int> servicedPopMatrix() const;
-    Matrix<int> unservicedPopMatrix() const;
-    Matrix<int> totalPopMatrix() const;
+    Matrix<PopCount> servicedPopMatrix() const;
+    Matrix<PopCount> unservicedPopMatrix() const;
+    Matrix<PopCount> totalPopMatrix() const;
+
+    /*
+     * Read-only views of the population layers. These do not copy, so any
+     * write to this PopulationMatrix invalidates them: a layer shared with a
+     * copy is cloned on its first write, leaving the view on the old buffer.
+     * Throws std::logic_error in sparse mode, which has no contiguous layers.
+     */
+    MatrixView<PopCount> servicedPopView() const;
+    MatrixView<PopCount> unservicedPopView() const;
+
     int sizeX() const;
     int sizeY() const;
     
@@ -0,0 +1,60 @@
+#ifndef MARS_SERVICEABLEAREASEARCH_H
+#define MARS_SERVICEABLEAREASEARCH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Coord.h"
+#include "CoverageStencil.h"
+#include "Terrain.h"
+
+namespace MARS {
+  /**
+   * ServiceableAreaSearch - bounded shortest paths from a plant over the terrain
+   *
+   * Runs Dijkstra with a bucket queue (Dial's algorithm) over the terrain's
+   * whole-number step costs. Costs are at most maxStepCost(), so the queue is
+   * a ring of maxStepCost() + 1 buckets and every push and pop is O(1). The
+   * search stops at the serving distance, so its work is proportional to the
+   * cells within reach rather than to the size of the map.
+   *
+   * When every cell within reach is grassland, the area is a diamond of
+   * Manhattan distances, so an interned CoverageShape is placed instead and
+   * no search runs. Checking for that takes one bit scan per row.
+   *
+   * Scratch space is kept between searches and only grows, so one instance
+   * should be reused for many searches, one thread at a time.
+   */
+  class ServiceableAreaSearch {
+  private:
+    /* Best distance found so far to a cell, valid when epoch is the current search */
+    struct Label {
+      std::uint32_t epoch;
+      std::uint32_t dist;
+    };
+
+    std::vector<Label> labels; // Indexed like the step cost grid
+    std::vector<std::vector<std::uint32_t>> buckets; // Cells to expand, by distance modulo the number of buckets
+    std::vector<std::uint64_t> found; // Cells reached, as (grid cell index << 32 | distance)
+    std::uint32_t epoch; // Number of the current search
+
+    void startSearch(std::size_t cells, int max_cost);
+
+    /*
+     * Whether every cell within radius steps of source, other than source,
+     * is grassland inside the terrain
+     */
+    static bool uniformGrass(const Terrain& terrain, const Coord& source, int radius);
+
+  public:
+    ServiceableAreaSearch();
+
+    /**
+     * Fill area with the distance to every cell within serve_dist of source,
+     * other than source itself
+     */
+    void run(const Terrain& terrain, const Coord& source, double serve_dist, CoverageStencil& area);
+  };
+}
+
+#endif
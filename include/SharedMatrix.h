@@ -0,0 +1,112 @@
+#ifndef MARS_SHAREDMATRIX_H
+#define MARS_SHAREDMATRIX_H
+
+#include <memory>
+#include <utility>
+
+#include "Matrix.h"
+#include "MatrixLayout.h"
+#include "MatrixView.h"
+
+namespace MARS {
+
+  /*
+   * SharedMatrix - a Matrix with copy-on-write storage
+   *
+   * Copies share one buffer, so snapshots cost O(1). The first write through
+   * a copy whose buffer is shared clones the whole buffer, after which the
+   * copies are independent. Reads never clone. A file-backed buffer is never
+   * shared: copies of it are cloned onto the heap at once, so the mapping
+   * stays with the original and later writes keep reaching the file.
+   *
+   * Write through write() once and keep the reference for loops, rather than
+   * calling the non-const at() per cell, so the sharing check is not repeated.
+   * Copies may be read from several threads, but a SharedMatrix must not be
+   * written while it is being copied.
+   */
+  template <class T, class Layout = RowMajorLayout>
+  class SharedMatrix {
+  private:
+    std::shared_ptr<Matrix<T, Layout>> shared;
+
+    static std::shared_ptr<Matrix<T, Layout>> copyOf(const std::shared_ptr<Matrix<T, Layout>>& buffer) {
+      if (buffer->fileBacked())
+        return std::make_shared<Matrix<T, Layout>>(*buffer);
+      return buffer;
+    }
+  public:
+
+    /*
+     * Constructor
+     * Takes in number of rows and columns, and Matrix flags
+     */
+    SharedMatrix(unsigned int rows, unsigned int cols, int flags = MATRIX_DENSE):
+      shared(std::make_shared<Matrix<T, Layout>>(rows, cols, flags))
+    {
+    }
+
+    /** Take ownership of an existing matrix, e.g. a file-backed one */
+    explicit SharedMatrix(Matrix<T, Layout>&& m):
+      shared(std::make_shared<Matrix<T, Layout>>(std::move(m)))
+    {
+    }
+
+    SharedMatrix(const SharedMatrix& other):
+      shared(copyOf(other.shared))
+    {
+    }
+
+    SharedMatrix& operator=(const SharedMatrix& other) {
+      if (this != &other)
+        shared = copyOf(other.shared);
+      return *this;
+    }
+
+    SharedMatrix(SharedMatrix&&) = default;
+    SharedMatrix& operator=(SharedMatrix&&) = default;
+
+    /**
+     * The underlying matrix, for reading
+     */
+    const Matrix<T, Layout>& read() const {
+      return *shared;
+    }
+
+    /**
+     * The underlying matrix, for writing. Clones the buffer first if it is
+     * shared with another copy. The clone always lives on the heap.
+     */
+    Matrix<T, Layout>& write() {
+      if (shared.use_count() > 1)
+        shared = std::make_shared<Matrix<T, Layout>>(*shared);
+      return *shared;
+    }
+
+    const T& at(unsigned int r, unsigned int c) const {
+      return shared->at(r, c);
+    }
+
+    T& at(unsigned int r, unsigned int c) {
+      return write().at(r, c);
+    }
+
+    MatrixView<T> view() const {
+      return shared->view();
+    }
+
+    unsigned int numberRows() const {
+      return shared->numberRows();
+    }
+
+    unsigned int numberCols() const {
+      return shared->numberCols();
+    }
+
+    /** Whether another copy currently shares this buffer */
+    bool isShared() const {
+      return shared.use_count() > 1;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,351 @@
+#ifndef MARS_SPARSETILEMATRIX_H
+#define MARS_SPARSETILEMATRIX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Matrix.h"
+#include "MatrixExpr.h"
+#include "MatrixView.h"
+
+#define SPARSE_TILE_SIZE 32 // Default tile edge, in cells
+
+namespace MARS {
+
+  /*
+   * SparseTileMatrix - a 2D matrix stored as a directory of Tile x Tile tiles,
+   * where tiles that have never held a non-default value are not allocated
+   *
+   * Reads of unallocated tiles return T(). Writing through the non-const at()
+   * allocates the tile, while set() of a default value never does. Tiles are
+   * row-major internally, so each one can be handed to the kernels as a
+   * MatrixView; cells past the right and bottom edges are always T().
+   */
+  template <class T, unsigned int Tile = SPARSE_TILE_SIZE>
+  class SparseTileMatrix {
+  private:
+    unsigned int num_rows; // Number of rows
+    unsigned int num_cols; // Number of columns
+    unsigned int tile_rows; // Number of rows of tiles
+    unsigned int tile_cols; // Number of tiles in each row of tiles
+    std::vector<T*> tiles; // Tile directory, row-major. Null for unallocated tiles
+
+    static const std::size_t tile_items = (std::size_t) Tile * Tile;
+
+    T* allocateTile() {
+      void* mem = detail::alignedAllocate(tile_items * sizeof(T), MATRIX_ALIGNMENT);
+      detail::allocationCount()++;
+      T* tile = static_cast<T*>(mem);
+      for (std::size_t i = 0; i < tile_items; i++) {
+        new (tile + i) T();
+      }
+      return tile;
+    }
+
+    static void freeTile(T* tile) {
+      if (tile == nullptr)
+        return;
+      for (std::size_t i = 0; i < tile_items; i++) {
+        tile[i].~T();
+      }
+      detail::alignedFree(tile);
+    }
+
+    void release() {
+      for (T*& tile : tiles) {
+        freeTile(tile);
+        tile = nullptr;
+      }
+    }
+
+    std::size_t tileIndex(unsigned int r, unsigned int c) const {
+      return (std::size_t) (r / Tile) * tile_cols + c / Tile;
+    }
+
+    static std::size_t offsetInTile(unsigned int r, unsigned int c) {
+      return (r % Tile) * Tile + c % Tile;
+    }
+
+  public:
+
+    /*
+     * TileRef - one allocated tile, and where it sits in the matrix
+     */
+    class TileRef {
+    private:
+      const T* tile_data;
+      unsigned int first_row;
+      unsigned int first_col;
+      unsigned int num_rows;
+      unsigned int num_cols;
+    public:
+      TileRef(const T* data, unsigned int row, unsigned int col, unsigned int rows, unsigned int cols):
+        tile_data(data), first_row(row), first_col(col), num_rows(rows), num_cols(cols) {}
+
+      /* Matrix coordinates of the tile's top left cell */
+      unsigned int row() const { return first_row; }
+      unsigned int col() const { return first_col; }
+
+      /* Number of rows and columns of the tile that lie inside the matrix */
+      unsigned int numberRows() const { return num_rows; }
+      unsigned int numberCols() const { return num_cols; }
+
+      /* Value at (r, c) relative to the tile's top left cell */
+      const T& at(unsigned int r, unsigned int c) const { return tile_data[r * Tile + c]; }
+
+      /* The in-bounds part of the tile */
+      MatrixView<T> view() const { return MatrixView<T>(tile_data, num_rows, num_cols, Tile); }
+    };
+
+    /*
+     * Iterates over the allocated tiles, skipping unallocated ones
+     */
+    class TileIterator {
+    private:
+      const SparseTileMatrix* m;
+      std::size_t index;
+
+      void skipEmpty() {
+        while (index < m->tiles.size() && m->tiles[index] == nullptr)
+          index++;
+      }
+    public:
+      TileIterator(const SparseTileMatrix* m, std::size_t index): m(m), index(index) {
+        skipEmpty();
+      }
+
+      TileRef operator*() const {
+        unsigned int row = (unsigned int) (index / m->tile_cols) * Tile;
+        unsigned int col = (unsigned int) (index % m->tile_cols) * Tile;
+        unsigned int rows = m->num_rows - row < Tile ? m->num_rows - row : Tile;
+        unsigned int cols = m->num_cols - col < Tile ? m->num_cols - col : Tile;
+        return TileRef(m->tiles[index], row, col, rows, cols);
+      }
+
+      TileIterator& operator++() {
+        index++;
+        skipEmpty();
+        return *this;
+      }
+
+      bool operator!=(const TileIterator& other) const {
+        return index != other.index;
+      }
+    };
+
+    /* Range over the allocated tiles, for use with range-based for */
+    class TileRange {
+    private:
+      const SparseTileMatrix* m;
+    public:
+      explicit TileRange(const SparseTileMatrix* m): m(m) {}
+      TileIterator begin() const { return TileIterator(m, 0); }
+      TileIterator end() const { return TileIterator(m, m->tiles.size()); }
+    };
+
+    /*
+     * Constructor
+     * Takes in number of rows and columns. No tiles are allocated.
+     */
+    SparseTileMatrix(unsigned int rows, unsigned int cols):
+      num_rows(rows),
+      num_cols(cols),
+      tile_rows((rows + Tile - 1) / Tile),
+      tile_cols((cols + Tile - 1) / Tile),
+      tiles((std::size_t) tile_rows * tile_cols, nullptr)
+    {
+    }
+
+    /** Copy constructor, only copies allocated tiles */
+    SparseTileMatrix(const SparseTileMatrix& other):
+      num_rows(other.num_rows),
+      num_cols(other.num_cols),
+      tile_rows(other.tile_rows),
+      tile_cols(other.tile_cols),
+      tiles(other.tiles.size(), nullptr)
+    {
+      for (std::size_t i = 0; i < tiles.size(); i++) {
+        if (other.tiles[i] != nullptr) {
+          tiles[i] = allocateTile();
+          std::copy(other.tiles[i], other.tiles[i] + tile_items, tiles[i]);
+        }
+      }
+    }
+
+    SparseTileMatrix(SparseTileMatrix&& other):
+      num_rows(other.num_rows),
+      num_cols(other.num_cols),
+      tile_rows(other.tile_rows),
+      tile_cols(other.tile_cols),
+      tiles(std::move(other.tiles))
+    {
+      other.tiles.clear();
+    }
+
+    SparseTileMatrix& operator=(SparseTileMatrix other) {
+      std::swap(num_rows, other.num_rows);
+      std::swap(num_cols, other.num_cols);
+      std::swap(tile_rows, other.tile_rows);
+      std::swap(tile_cols, other.tile_cols);
+      tiles.swap(other.tiles);
+      return *this;
+    }
+
+    ~SparseTileMatrix() {
+      release();
+    }
+
+    /**
+     * Value at location, T() if its tile is unallocated
+     */
+    T at(unsigned int r, unsigned int c) const {
+      #ifdef FLAG_MATRIX_BOUNDS_CHECKING
+      if (r >= num_rows || c >= num_cols)
+        throw -1;
+      #endif
+      const T* tile = tiles[tileIndex(r, c)];
+      return tile == nullptr ? T() : tile[offsetInTile(r, c)];
+    }
+
+    /**
+     * Access reference to data at location, allocating its tile if needed
+     */
+    T& at(unsigned int r, unsigned int c) {
+      #ifdef FLAG_MATRIX_BOUNDS_CHECKING
+      if (r >= num_rows || c >= num_cols)
+        throw -1;
+      #endif
+      T*& tile = tiles[tileIndex(r, c)];
+      if (tile == nullptr)
+        tile = allocateTile();
+      return tile[offsetInTile(r, c)];
+    }
+
+    /**
+     * Write a value, without allocating a tile to hold T()
+     */
+    void set(unsigned int r, unsigned int c, const T& value) {
+      if (value == T() && tiles[tileIndex(r, c)] == nullptr)
+        return;
+      at(r, c) = value;
+    }
+
+    /**
+     * dest += e for every cell, in one pass. Tiles are only allocated where e is
+     * non-zero. e may read from this matrix.
+     */
+    template <class E>
+    void addAssign(const E& e) {
+      typename expr::AsExpr<E>::type node = expr::AsExpr<E>::wrap(e);
+      for (unsigned int tr = 0; tr < tile_rows; tr++) {
+        for (unsigned int tc = 0; tc < tile_cols; tc++) {
+          T*& tile = tiles[(std::size_t) tr * tile_cols + tc];
+          unsigned int row_end = std::min(num_rows, (tr + 1) * Tile);
+          unsigned int col_end = std::min(num_cols, (tc + 1) * Tile);
+          for (unsigned int r = tr * Tile; r < row_end; r++) {
+            for (unsigned int c = tc * Tile; c < col_end; c++) {
+              T current = tile == nullptr ? T() : tile[offsetInTile(r, c)];
+              T updated = expr::saturate<T>(current + node.at(r, c));
+              if (tile == nullptr) {
+                if (updated == T())
+                  continue;
+                tile = allocateTile();
+              }
+              tile[offsetInTile(r, c)] = updated;
+            }
+          }
+        }
+      }
+    }
+
+    /**
+     * Free tiles whose cells have all returned to T()
+     */
+    void releaseEmptyTiles() {
+      for (T*& tile : tiles) {
+        if (tile == nullptr)
+          continue;
+        bool empty = true;
+        for (std::size_t i = 0; i < tile_items && empty; i++) {
+          empty = tile[i] == T();
+        }
+        if (empty) {
+          freeTile(tile);
+          tile = nullptr;
+        }
+      }
+    }
+
+    /**
+     * The allocated tiles, in row-major tile order
+     */
+    TileRange nonEmptyTiles() const {
+      return TileRange(this);
+    }
+
+    /**
+     * Write every cell into a dense matrix of the same dimensions
+     */
+    void copyTo(Matrix<T>& dest) const {
+      dest.resetToDefault();
+      for (TileRef tile : nonEmptyTiles()) {
+        for (unsigned int r = 0; r < tile.numberRows(); r++) {
+          T* out = dest.rowPtr(tile.row() + r) + tile.col();
+          for (unsigned int c = 0; c < tile.numberCols(); c++) {
+            out[c] = tile.at(r, c);
+          }
+        }
+      }
+    }
+
+    unsigned int numberRows() const {
+      return num_rows;
+    }
+
+    unsigned int numberCols() const {
+      return num_cols;
+    }
+
+    std::size_t numberTiles() const {
+      return tiles.size();
+    }
+
+    std::size_t numberAllocatedTiles() const {
+      std::size_t count = 0;
+      for (const T* tile : tiles) {
+        count += tile != nullptr;
+      }
+      return count;
+    }
+  };
+
+  /*
+   * Leaf node reading from a SparseTileMatrix
+   */
+  template <class T, unsigned int Tile>
+  class SparseTileExpr : public MatrixExprTag {
+  private:
+    const SparseTileMatrix<T, Tile>* m;
+  public:
+    typedef T value_type;
+
+    explicit SparseTileExpr(const SparseTileMatrix<T, Tile>& m): m(&m) {}
+
+    unsigned int numberRows() const { return m->numberRows(); }
+    unsigned int numberCols() const { return m->numberCols(); }
+    T at(unsigned int r, unsigned int c) const { return m->at(r, c); }
+  };
+
+  namespace expr {
+    template <class T, unsigned int Tile>
+    struct AsExpr<SparseTileMatrix<T, Tile>> {
+      typedef SparseTileExpr<T, Tile> type;
+      static type wrap(const SparseTileMatrix<T, Tile>& m) { return type(m); }
+    };
+  }
+}
+
+#endif
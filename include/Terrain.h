@@ -1,11 +1,16 @@
 #ifndef MARS_TERRAIN_H
 #define MARS_TERRAIN_H
 
+#include <cstdint>
 #include <ctime>
 #include <limits>
+#include <memory>
+#include <string>
 
 #include "PerlinNoise.h"
+#include "BitMatrix.h"
 #include "Matrix.h"
+#include "SharedMatrix.h"
 #include "Coord.h"
 
 #define GRASSLAND_THRESHOLD 0.3
@@ -13,16 +18,30 @@
 #define WATER_WEIGHT std::numeric_limits<float>::max()
 #define GRASSLAND_WEIGHT 1.0
 #define MOUNTAIN_WEIGHT 100.0
+#define IMPASSABLE_STEP_COST 255 // Step cost of water, and of the border around the step cost grid
 
 namespace MARS {
 
   class Terrain {
   private:
     siv::PerlinNoise perlin;
-    Matrix<float> weightMatrix;
-    Matrix<int> terrainMatrix; //Holds terrain type, not weights
+    // Shared between copies of a Terrain, which is never modified once generated
+    SharedMatrix<float> weightMatrix;
+    SharedMatrix<int> terrainMatrix; //Holds terrain type, not weights
+    SharedMatrix<std::uint8_t> stepCostMatrix; // Whole-number weights, with a border. See stepCosts()
+    int max_step_cost;
+    std::shared_ptr<const BitMatrix> non_grass_mask; // Shared by copies, see nonGrassMask()
+    std::uint64_t generation_id; // Identifies the weights, see generationId()
     int size_x;
     int size_y;
+
+    Terrain(int dx, int dy, const std::string& path, bool reuse);
+
+    /* Fill in the weight and terrain type matrices from Perlin noise */
+    void generate();
+
+    /* Fill in the step cost grid from the weights. Called once the weights are final. */
+    void buildStepCosts();
   public:
 
 
@@ -30,9 +49,49 @@ namespace MARS {
     Terrain(int dim);
     Terrain(int dx, int dy, bool water);
 
+    /*
+     * Terrain stored on disk, in the files path.weights.mat and path.types.mat,
+     * which are paged in on demand. If they already hold a terrain of these
+     * dimensions it is reopened as is, otherwise a new one is generated into them.
+     */
+    Terrain(int dx, int dy, const std::string& path);
+
     Matrix<float> getMatrixCopy() const;
     Matrix<int> getTerrainMatrix() const;
 
+    /*
+     * Read-only views of the weight and terrain type matrices, without copying
+     */
+    MatrixView<float> weightView() const;
+    MatrixView<int> terrainView() const;
+
+    /*
+     * Weights as whole-number costs of stepping onto each cell, for shortest
+     * path searches. Cell (x, y) is at (x + 1, y + 1): the grid has a one cell
+     * border of IMPASSABLE_STEP_COST, as do water and any weight of 255 or
+     * more, so searches need no bounds checks. Fractional weights are rounded up.
+     */
+    const Matrix<std::uint8_t>& stepCosts() const;
+
+    /* Largest passable step cost */
+    int maxStepCost() const;
+
+    /* Step cost of grassland */
+    int grassStepCost() const;
+
+    /*
+     * Set for every cell whose step cost is not grassland's, so searches can
+     * tell whether a region is uniform a word of cells at a time
+     */
+    const BitMatrix& nonGrassMask() const;
+
+    /*
+     * Id of the terrain's weights, unique within the process. Copies share the
+     * id of the terrain they were copied from, so it can key caches of
+     * anything computed from the weights.
+     */
+    std::uint64_t generationId() const;
+
     int sizeX() const;
     int sizeY() const;
     float weightAtXY(int x, int y) const;
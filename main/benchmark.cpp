@@ -0,0 +1,172 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/Coord.h"
+#include "../include/CoordMap.h"
+#include "../include/Matrix.h"
+#include "../include/MatrixLayout.h"
+#include "../include/Terrain.h"
+
+using namespace MARS;
+
+/*
+ * Benchmarks for the simulator's hot paths.
+ *
+ * Usage: ./benchmark [grid size] [number of plants]
+ */
+
+/*
+ * Serviceable area search with the same 4-neighbour expansion as
+ * Plant::generateServiceableArea, over matrices of the given layout. Scratch
+ * buffers are reused between calls so that only grid access is being measured.
+ * Returns the number of serviceable cells.
+ */
+template <class Layout>
+std::size_t serviceableArea(
+  const Matrix<float, Layout>& weights,
+  Matrix<unsigned char, Layout>& visited,
+  std::vector<std::pair<Coord, double>>& queue,
+  const Coord& plant_loc,
+  double serve_dist)
+{
+  int size_x = weights.numberRows();
+  int size_y = weights.numberCols();
+  std::size_t serviceable = 1;
+  queue.clear();
+  queue.push_back(std::make_pair(plant_loc, 0.0));
+  visited.at(plant_loc.x, plant_loc.y) = 1;
+
+  for (std::size_t head = 0; head < queue.size(); head++) {
+    Coord loc = queue[head].first;
+    double weighted_dist = queue[head].second;
+    const Coord neighbors[4] = {
+      Coord(loc.x, loc.y-1),
+      Coord(loc.x, loc.y+1),
+      Coord(loc.x-1, loc.y),
+      Coord(loc.x+1, loc.y)
+    };
+    for (const Coord& neighbor : neighbors) {
+      if (!(neighbor.x >= 0 && neighbor.y >= 0 && neighbor.x < size_x && neighbor.y < size_y))
+        continue;
+      unsigned char& seen = visited.at(neighbor.x, neighbor.y);
+      if (seen)
+        continue;
+      seen = 1;
+      double dist = weighted_dist + weights.at(neighbor.x, neighbor.y);
+      if (dist <= serve_dist) {
+        serviceable++;
+        queue.push_back(std::make_pair(neighbor, dist));
+      }
+    }
+  }
+
+  // Only unmark what was touched, so the cost does not scale with the grid
+  for (const std::pair<Coord, double>& entry : queue) {
+    const Coord& loc = entry.first;
+    visited.at(loc.x, loc.y) = 0;
+    if (loc.x > 0) visited.at(loc.x-1, loc.y) = 0;
+    if (loc.y > 0) visited.at(loc.x, loc.y-1) = 0;
+    if (loc.x+1 < size_x) visited.at(loc.x+1, loc.y) = 0;
+    if (loc.y+1 < size_y) visited.at(loc.x, loc.y+1) = 0;
+  }
+  return serviceable;
+}
+
+template <class Layout>
+void benchmarkLayout(const std::string& name, const Terrain& terrain, const std::vector<Coord>& plants, double serve_dist) {
+  Matrix<float, Layout> weights(terrain.weightView());
+  Matrix<unsigned char, Layout> visited(terrain.sizeX(), terrain.sizeY());
+  std::vector<std::pair<Coord, double>> queue;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::size_t cells = 0;
+  for (const Coord& plant : plants) {
+    cells += serviceableArea(weights, visited, queue, plant, serve_dist);
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << "  " << name << "\t" << elapsed.count() / plants.size() << " ms/plant\t"
+            << cells / plants.size() << " cells/plant" << std::endl;
+}
+
+void benchmarkLayouts(int size, int number_plants) {
+  Terrain terrain(size, size);
+  std::vector<Coord> plants;
+  while (plants.size() < (std::size_t) number_plants) {
+    Coord c(std::rand() % size, std::rand() % size);
+    if (terrain.weightAtCoord(c) == GRASSLAND_WEIGHT)
+      plants.push_back(c);
+  }
+
+  std::cout << "Serviceable area generation, " << size << "x" << size << " grid" << std::endl;
+  const double serve_dists[] = {25, 100, 400};
+  for (double serve_dist : serve_dists) {
+    std::cout << "Serve distance " << serve_dist << std::endl;
+    benchmarkLayout<RowMajorLayout>("row-major", terrain, plants, serve_dist);
+    benchmarkLayout<TiledLayout<8>>("tiled 8x8", terrain, plants, serve_dist);
+    benchmarkLayout<MortonLayout>("morton", terrain, plants, serve_dist);
+  }
+}
+
+/*
+ * Builds a serviceable-area sized map around each plant, then looks every cell
+ * of its bounding box up in it, as Plant and PopulationMatrix do. Returns the
+ * number of hits so the work cannot be optimized away.
+ */
+template <class Map>
+std::size_t coordMapWorkload(Map& map, const std::vector<Coord>& plants, int radius) {
+  std::size_t hits = 0;
+  for (const Coord& plant : plants) {
+    map.clear();
+    for (int dx = -radius; dx <= radius; dx++) {
+      int span = radius - std::abs(dx);
+      for (int dy = -span; dy <= span; dy++) {
+        map[Coord(plant.x + dx, plant.y + dy)] = std::abs(dx) + std::abs(dy);
+      }
+    }
+    for (int dx = -radius; dx <= radius; dx++) {
+      for (int dy = -radius; dy <= radius; dy++) {
+        hits += map.count(Coord(plant.x + dx, plant.y + dy));
+      }
+    }
+  }
+  return hits;
+}
+
+template <class Map>
+void benchmarkCoordMap(const std::string& name, Map map, const std::vector<Coord>& plants, int radius) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::size_t hits = coordMapWorkload(map, plants, radius);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << "  " << name << "\t" << elapsed.count() / plants.size() << " ms/plant\t"
+            << hits / plants.size() << " hits/plant" << std::endl;
+}
+
+void benchmarkCoordMaps(int size, int number_plants) {
+  std::vector<Coord> plants;
+  for (int i = 0; i < number_plants; i++) {
+    plants.push_back(Coord(std::rand() % size, std::rand() % size));
+  }
+
+  std::cout << "Coord maps, " << size << "x" << size << " grid" << std::endl;
+  const int radii[] = {10, 50, 200};
+  for (int radius : radii) {
+    std::cout << "Radius " << radius << std::endl;
+    benchmarkCoordMap("std::unordered_map", std::unordered_map<Coord, double>(), plants, radius);
+    benchmarkCoordMap("CoordMap", CoordMap<double>(), plants, radius);
+    benchmarkCoordMap("CoordMap, cell index", CoordMap<double>(size), plants, radius);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int size = argc > 1 ? std::atoi(argv[1]) : 2048;
+  int number_plants = argc > 2 ? std::atoi(argv[2]) : 50;
+  benchmarkLayouts(size, number_plants);
+  benchmarkCoordMaps(size, number_plants);
+  return 0;
+}
@@ -1,13 +1,34 @@
 #include <pybind11/pybind11.h>
 #include <string>
+#include <type_traits>
 
 #include "Coord.h"
+#include "CoverageCache.h"
 #include "Game.h"
 #include "CLIRepl.h"
 #include "Matrix.h"
 
 namespace py = pybind11;
 
+/*
+ * Expose Matrix<T> to Python through the buffer protocol, so that numpy can
+ * read it in place.
+ */
+template <class T>
+void bindMatrix(py::module& m, const char* name) {
+  py::class_<MARS::Matrix<T>>(m, name, py::buffer_protocol())
+    .def_buffer([](MARS::Matrix<T>& m) -> py::buffer_info {
+      return py::buffer_info(
+        m.ptr(),                              /* Pointer to buffer */
+        sizeof(T),                            /* Size of one item */
+        py::format_descriptor<T>::format(),   /* Python struct-style format */
+        2,                                    /* Number of dimensions */
+        { m.numberRows(), m.numberCols() },   /* Buffer dimensions */
+        { sizeof(T) * m.stride(),             /* Strides in bytes */
+          sizeof(T) }
+      );
+    });
+}
 
 
 PYBIND11_PLUGIN(project_mars) {
@@ -40,45 +61,16 @@ PYBIND11_PLUGIN(project_mars) {
       py::arg("x"),
       py::arg("y"));
 
-  py::class_<MARS::Matrix<int>>(m, "IntMatrix", py::buffer_protocol())
-    .def_buffer([](MARS::Matrix<int>& m) -> py::buffer_info {
-      return py::buffer_info(
-        m.ptr(),                              /* Pointer to buffer */
-        sizeof(int),                          /* Size of one item */
-        py::format_descriptor<int>::format(), /* Python struct-style format */
-        2,                                    /* Number of dimensions */
-        { m.numberRows(), m.numberCols() },   /* Buffer dimensions */
-        { sizeof(int) * m.numberCols(),       /* Strides in bytes */
-          sizeof(int) }
-      );
-    });
-
-  py::class_<MARS::Matrix<bool>>(m, "BoolMatrix", py::buffer_protocol())
-    .def_buffer([](MARS::Matrix<bool>& m) -> py::buffer_info {
-      return py::buffer_info(
-        m.ptr(),                               /* Pointer to buffer */
-        sizeof(bool),                          /* Size of one item */
-        py::format_descriptor<bool>::format(), /* Python struct-style format */
-        2,                                     /* Number of dimensions */
-        { m.numberRows(), m.numberCols() },    /* Buffer dimensions */
-        { sizeof(bool) * m.numberCols(),       /* Strides in bytes */
-          sizeof(bool) }
-      );
-    });
-
-  py::class_<MARS::Matrix<float>>(m, "FloatMatrix", py::buffer_protocol())
-    .def_buffer([](MARS::Matrix<float>& m) -> py::buffer_info {
-      return py::buffer_info(
-        m.ptr(),                                /* Pointer to buffer */
-        sizeof(float),                          /* Size of one item */
-        py::format_descriptor<float>::format(), /* Python struct-style format */
-        2,                                      /* Number of dimensions */
-        { m.numberRows(), m.numberCols() },     /* Buffer dimensions */
-        { sizeof(float) * m.numberCols(),       /* Strides in bytes */
-          sizeof(float) }
-      );
-    });
+  bindMatrix<int>(m, "IntMatrix");
+  bindMatrix<bool>(m, "BoolMatrix");
+  bindMatrix<float>(m, "FloatMatrix");
+  // Population layers are exported in their narrow element type, without widening
+  if (!std::is_same<MARS::PopCount, int>::value)
+    bindMatrix<MARS::PopCount>(m, "PopMatrix");
 
+  py::enum_<MARS::AssignmentEngine>(m, "AssignmentEngine")
+    .value("GREEDY", MARS::GREEDY_ASSIGNMENT)
+    .value("MIN_COST_FLOW", MARS::MIN_COST_FLOW_ASSIGNMENT);
 
 	py::class_<MARS::Game> game(m, "Game");
 	game
@@ -91,8 +83,11 @@ PYBIND11_PLUGIN(project_mars) {
         double,
         double,
         double,
-        double>(),
-      "Initializer for Game.",
+        double,
+        const std::string&,
+        bool>(),
+      "Initializer for Game. If storage_path names a directory, the terrain and population layers are kept in files there. "
+      "If sparse_population is set, population layers are kept in tiles that are only allocated once populated.",
       py::arg("dx"),
       py::arg("dy"),
       py::arg("number_of_turns"),
@@ -101,7 +96,9 @@ PYBIND11_PLUGIN(project_mars) {
       py::arg("initial_cost"),
       py::arg("operating_cost"),
       py::arg("profit_margin"),
-      py::arg("unserviced_penalty"))
+      py::arg("unserviced_penalty"),
+      py::arg("storage_path") = "",
+      py::arg("sparse_population") = false)
 		.def("step", &MARS::Game::step,
 		  "Advance the game's progress by one time step.",
 		  py::arg("add_plant"),
@@ -110,6 +107,9 @@ PYBIND11_PLUGIN(project_mars) {
       "Get the value of the objective fn the current state of the game.")
     .def("get_total_serviced", &MARS::Game::numberServicedPop,
       "Gets the total number of pops that are being serviced by our plants")
+    .def("set_assignment_engine", &MARS::Game::setAssignmentEngine,
+      "Choose how people are assigned to plants from the next step on.",
+      py::arg("engine"))
     .def_readonly("state", &MARS::Game::rlState);
 
   py::class_<MARS::Game::RLState> (m, "RLState", game)
@@ -119,6 +119,11 @@ PYBIND11_PLUGIN(project_mars) {
     .def_readwrite("terrain", &MARS::Game::RLState::terrain)
     .def_readwrite("plants", &MARS::Game::RLState::plantLocs);
 
+  m.def("coverage_cache_hits", []() { return MARS::CoverageCache::shared().hits(); },
+    "Number of serviceable areas found in the shared coverage cache.");
+  m.def("coverage_cache_misses", []() { return MARS::CoverageCache::shared().misses(); },
+    "Number of serviceable areas that had to be searched for.");
+
 
 
 	return m.ptr();
@@ -34,7 +34,7 @@ int main() {
       game->step(false, Coord(0, 0));
     }
     else { //cluster
-      std::pair<bool, Coord> res = Clustering::placePlantKMeans(game->popMatrixCopy(), k);
+      std::pair<bool, Coord> res = Clustering::placePlantKMeans(game->popMatrixView(), k);
       game->step(res.first, res.second);
     }
   }
@@ -1,20 +1,112 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <new>
+#include <utility>
 #include <cmath>
+#include <limits>
+#include <queue>
+#include <functional>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
+#include <stdexcept>
+#include <string>
 #include <gtest/gtest.h>
 
 #include "Clustering.h"
 #include "Coord.h"
+#include "CoordMap.h"
+#include "CoverageCache.h"
+#include "CoverageIndex.h"
+#include "CoverageStencil.h"
 #include "Game.h"
 #include "Matrix.h"
+#include "MatrixExpr.h"
+#include "MatrixKernels.h"
 #include "BitMatrix.h"
+#include "AssignmentFlow.h"
 #include "PopulationGen.h"
 #include "Terrain.h"
 #include "PopulationMatrix.h"
+#include "SharedMatrix.h"
+#include "SparseTileMatrix.h"
 #include "Plant.h"
+#include "PlantAssignments.h"
+#include "PlantPool.h"
+
+
+#ifdef __GNUC__
+  #define TEST_NOINLINE __attribute__((noinline))
+#else
+  #define TEST_NOINLINE
+#endif
+
+namespace {
+  // Number of calls to the global operator new, for allocation-free tests
+  std::atomic<std::size_t> heap_allocations(0);
+
+  // Not inlined, so GCC does not pair the malloc and free with the new and
+  // delete expressions that reach them and warn -Wmismatched-new-delete
+  TEST_NOINLINE void* countedAlloc(std::size_t size) noexcept {
+    heap_allocations++;
+    return std::malloc(size == 0 ? 1 : size);
+  }
+
+  TEST_NOINLINE void countedFree(void* mem) noexcept {
+    std::free(mem);
+  }
+}
+
+// Every replaceable form is replaced, so no allocation mixes malloc with the default heap
+void* operator new(std::size_t size) {
+  void* mem = countedAlloc(size);
+  if (mem == nullptr)
+    throw std::bad_alloc();
+  return mem;
+}
+
+void* operator new[](std::size_t size) {
+  void* mem = countedAlloc(size);
+  if (mem == nullptr)
+    throw std::bad_alloc();
+  return mem;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size);
+}
+
+void operator delete(void* mem) noexcept {
+  countedFree(mem);
+}
+
+void operator delete[](void* mem) noexcept {
+  countedFree(mem);
+}
+
+void operator delete(void* mem, const std::nothrow_t&) noexcept {
+  countedFree(mem);
+}
+
+void operator delete[](void* mem, const std::nothrow_t&) noexcept {
+  countedFree(mem);
+}
+
+// Libraries built as C++14 call the sized forms even when the tests are C++11
+void operator delete(void* mem, std::size_t) noexcept {
+  countedFree(mem);
+}
+
+void operator delete[](void* mem, std::size_t) noexcept {
+  countedFree(mem);
+}
 
 
 namespace {
@@ -61,6 +153,419 @@ namespace {
       }
     };
 
+    TEST_F(MarsTest, MatrixPaddedRowsAligned) {
+      int num_rows = 7;
+      int num_cols = 5;
+      MARS::Matrix<int> matrix(num_rows, num_cols, MARS::MATRIX_PADDED);
+
+      EXPECT_GE(matrix.stride(), matrix.numberCols());
+      EXPECT_EQ(0, (matrix.stride() * sizeof(int)) % MATRIX_ALIGNMENT);
+      for (int i = 0; i < num_rows; i++) {
+        EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(matrix.rowPtr(i)) % MATRIX_ALIGNMENT);
+        for (int j = 0; j < num_cols; j++) {
+          matrix.at(i, j) = i * num_cols + j;
+        }
+      }
+
+      MARS::Matrix<int> copy = matrix;
+      EXPECT_EQ(matrix.stride(), copy.stride());
+      for (int i = 0; i < num_rows; i++) {
+        for (int j = 0; j < num_cols; j++) {
+          EXPECT_EQ(copy.rowPtr(i)[j], i * num_cols + j);
+        }
+      }
+    }
+
+    TEST_F(MarsTest, MatrixViewSlicesWithoutCopying) {
+      MARS::Matrix<int> matrix(6, 9, MARS::MATRIX_PADDED);
+      for (int i = 0; i < 6; i++) {
+        for (int j = 0; j < 9; j++) {
+          matrix.at(i, j) = 10 * i + j;
+        }
+      }
+
+      MARS::MatrixView<int> view = matrix.view();
+      EXPECT_EQ(view.ptr(), matrix.ptr());
+      EXPECT_EQ(view.stride(), matrix.stride());
+
+      MARS::MatrixView<int> row = view.row(4);
+      EXPECT_EQ(row.numberRows(), 1);
+      EXPECT_EQ(row.at(0, 3), 43);
+
+      MARS::MatrixView<int> sub = view.subView(2, 3, 3, 4);
+      EXPECT_EQ(sub.numberRows(), 3);
+      EXPECT_EQ(sub.numberCols(), 4);
+      EXPECT_EQ(sub.at(0, 0), 23);
+      EXPECT_EQ(sub.at(2, 3), 46);
+
+      matrix.at(3, 4) = -1;
+      EXPECT_EQ(sub.at(1, 1), -1);
+
+      MARS::Matrix<int> copy(sub);
+      EXPECT_EQ(copy.at(2, 3), 46);
+    }
+
+    TEST_F(MarsTest, MatrixMoveAssignStealsStorage) {
+      MARS::Matrix<int> matrix(4, 4);
+      MARS::Matrix<int> other(16, 16);
+      other.at(15, 15) = 7;
+      int* storage = other.ptr();
+
+      matrix = std::move(other);
+      EXPECT_EQ(matrix.ptr(), storage);
+      EXPECT_EQ(matrix.numberRows(), 16);
+      EXPECT_EQ(matrix.at(15, 15), 7);
+    }
+
+    TEST_F(MarsTest, MatrixKernelsMatchScalar) {
+      // Odd widths exercise the vector tails, the sub view exercises unaligned rows
+      int rows = 13;
+      int cols = 37;
+      MARS::Matrix<int> a(rows, cols, MARS::MATRIX_PADDED);
+      MARS::Matrix<int> b(rows, cols);
+      MARS::Matrix<float> f(rows, cols);
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          a.at(i, j) = std::rand() % 2001 - 1000;
+          b.at(i, j) = std::rand() % 2001 - 1000;
+          f.at(i, j) = (std::rand() % 2001 - 1000) / 8.0f;
+        }
+      }
+      a.at(5, 7) = 50000;
+
+      MARS::MatrixView<int> sub = a.view().subView(1, 3, rows - 2, cols - 5);
+      std::int64_t sum = 0, sum_squares = 0;
+      int max = sub.at(0, 0);
+      std::size_t above = 0;
+      for (int i = 0; i < sub.numberRows(); i++) {
+        for (int j = 0; j < sub.numberCols(); j++) {
+          sum += sub.at(i, j);
+          sum_squares += (std::int64_t) sub.at(i, j) * sub.at(i, j);
+          max = std::max(max, sub.at(i, j));
+          above += sub.at(i, j) > 100;
+        }
+      }
+      EXPECT_EQ(MARS::MatrixKernels::sum(sub), sum);
+      EXPECT_EQ(MARS::MatrixKernels::sumOfSquares(sub), sum_squares);
+      EXPECT_EQ(MARS::MatrixKernels::max(sub), 50000);
+      EXPECT_EQ(MARS::MatrixKernels::max(sub), max);
+      EXPECT_EQ(MARS::MatrixKernels::countAbove(sub, 100), above);
+
+      double float_sum = 0;
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          float_sum += f.at(i, j);
+        }
+      }
+      EXPECT_DOUBLE_EQ(MARS::MatrixKernels::sum(f.view()), float_sum);
+
+      MARS::Matrix<int> total(rows, cols);
+      MARS::Matrix<int> accumulated = b;
+      MARS::MatrixKernels::add(a.view(), b.view(), total);
+      MARS::MatrixKernels::addInto(accumulated, a.view());
+      MARS::MatrixKernels::clamp(total, -50, 50);
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          EXPECT_EQ(accumulated.at(i, j), a.at(i, j) + b.at(i, j));
+          EXPECT_EQ(total.at(i, j), std::min(50, std::max(-50, a.at(i, j) + b.at(i, j))));
+        }
+      }
+    }
+
+    TEST_F(MarsTest, MatrixExpressionsFuseIntoDestination) {
+      int rows = 5;
+      int cols = 19;
+      MARS::Matrix<int> a(rows, cols, MARS::MATRIX_PADDED);
+      MARS::Matrix<int> b(rows, cols);
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          a.at(i, j) = i * cols + j - 40;
+          b.at(i, j) = (i * 13 + j * 7) % 31;
+        }
+      }
+
+      MARS::Matrix<int> out(rows, cols);
+      std::size_t before = MARS::detail::allocationCount();
+      MARS::assign(out, MARS::min(MARS::max(a + b * 2 - 3, 0), 50));
+      std::int64_t total = MARS::sum(a + b);
+      std::size_t positive = MARS::count(a - b > 0);
+      int largest = MARS::maxOf(a.view() - b);
+      MARS::addAssign(out, out + 1);
+      EXPECT_EQ(before, MARS::detail::allocationCount());
+
+      std::int64_t expected_total = 0;
+      std::size_t expected_positive = 0;
+      int expected_largest = std::numeric_limits<int>::lowest();
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          int fused = std::min(std::max(a.at(i, j) + b.at(i, j) * 2 - 3, 0), 50);
+          EXPECT_EQ(out.at(i, j), 2 * fused + 1);
+          expected_total += a.at(i, j) + b.at(i, j);
+          expected_positive += a.at(i, j) - b.at(i, j) > 0 ? 1 : 0;
+          expected_largest = std::max(expected_largest, a.at(i, j) - b.at(i, j));
+        }
+      }
+      EXPECT_EQ(total, expected_total);
+      EXPECT_EQ(positive, expected_positive);
+      EXPECT_EQ(largest, expected_largest);
+    }
+
+    TEST_F(MarsTest, MatrixNarrowKernelsSaturate) {
+      int rows = 3;
+      int cols = 71;
+      MARS::Matrix<std::uint16_t> a(rows, cols, MARS::MATRIX_PADDED);
+      MARS::Matrix<std::uint16_t> b(rows, cols);
+      MARS::Matrix<std::uint8_t> small(rows, cols, MARS::MATRIX_PADDED);
+      std::int64_t sum = 0, sum_squares = 0;
+      std::int64_t small_sum = 0, small_squares = 0;
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          a.at(i, j) = (std::uint16_t) (65000 + i * 7 + j * 3);
+          b.at(i, j) = (std::uint16_t) (j * 20);
+          small.at(i, j) = (std::uint8_t) (200 + j % 50);
+          sum += a.at(i, j);
+          sum_squares += (std::int64_t) a.at(i, j) * a.at(i, j);
+          small_sum += small.at(i, j);
+          small_squares += small.at(i, j) * small.at(i, j);
+        }
+      }
+      EXPECT_EQ(sum, MARS::MatrixKernels::sum(a.view()));
+      EXPECT_EQ(sum_squares, MARS::MatrixKernels::sumOfSquares(a.view()));
+      EXPECT_EQ(small_sum, MARS::MatrixKernels::sum(small.view()));
+      EXPECT_EQ(small_squares, MARS::MatrixKernels::sumOfSquares(small.view()));
+      EXPECT_EQ(65000 + (rows - 1) * 7 + (cols - 1) * 3, MARS::MatrixKernels::max(a.view()));
+      EXPECT_EQ(249, MARS::MatrixKernels::max(small.view()));
+
+      MARS::Matrix<std::uint16_t> expected = a;
+      MARS::MatrixKernels::addInto(a, b.view());
+      MARS::MatrixKernels::addInto(small, small.view());
+      MARS::Matrix<std::uint16_t> fused(rows, cols);
+      MARS::assign(fused, expected - b * 4);
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          EXPECT_EQ(std::min(65535, expected.at(i, j) + b.at(i, j)), a.at(i, j));
+          EXPECT_EQ(255, small.at(i, j));
+          EXPECT_EQ(std::max(0, expected.at(i, j) - b.at(i, j) * 4), fused.at(i, j));
+        }
+      }
+    }
+
+    TEST_F(MarsTest, MatrixLayoutsAgree) {
+      int rows = 13;
+      int cols = 37;
+      MARS::Matrix<int> row_major(rows, cols, MARS::MATRIX_PADDED);
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          row_major.at(i, j) = i * 1000 + j;
+        }
+      }
+
+      MARS::Matrix<int, MARS::TiledLayout<8>> tiled(row_major.view());
+      MARS::Matrix<int, MARS::MortonLayout> morton(rows, cols);
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          morton.at(i, j) = row_major.at(i, j);
+        }
+      }
+      // Every cell must land on its own slot
+      MARS::Matrix<int, MARS::MortonLayout> morton_copy = morton;
+
+      MARS::Matrix<int> tiled_export = tiled.rowMajorCopy();
+      MARS::Matrix<int> morton_export = morton_copy.rowMajorCopy();
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          EXPECT_EQ(tiled.at(i, j), i * 1000 + j);
+          EXPECT_EQ(morton_copy.at(i, j), i * 1000 + j);
+          EXPECT_EQ(tiled_export.at(i, j), i * 1000 + j);
+          EXPECT_EQ(morton_export.at(i, j), i * 1000 + j);
+        }
+      }
+      EXPECT_EQ(tiled_export.stride(), (unsigned int) cols);
+    }
+
+    TEST_F(MarsTest, MatrixFileReopens) {
+      std::string path = "mars_test_matrix.mat";
+      {
+        MARS::Matrix<int> m = MARS::Matrix<int>::createFile(path, 7, 21, MARS::MATRIX_PADDED);
+        EXPECT_TRUE(m.fileBacked());
+        EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(m.ptr()) % MATRIX_ALIGNMENT);
+        for (int i = 0; i < 7; i++) {
+          for (int j = 0; j < 21; j++) {
+            EXPECT_EQ(0, m.at(i, j));
+            m.at(i, j) = i * 21 + j;
+          }
+        }
+        MARS::Matrix<int> copy = m;
+        EXPECT_FALSE(copy.fileBacked());
+      }
+
+      EXPECT_TRUE(MARS::Matrix<int>::fileMatches(path, 7, 21));
+      EXPECT_FALSE(MARS::Matrix<int>::fileMatches(path, 21, 7));
+      EXPECT_FALSE(MARS::Matrix<float>::fileMatches(path, 7, 21));
+      EXPECT_THROW(MARS::Matrix<float>::openFile(path), std::runtime_error);
+
+      MARS::Matrix<int> reopened = MARS::Matrix<int>::openFile(path);
+      EXPECT_EQ(7, reopened.numberRows());
+      EXPECT_EQ(21, reopened.numberCols());
+      EXPECT_EQ(MARS::MATRIX_PADDED, reopened.storageFlags());
+      for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 21; j++) {
+          EXPECT_EQ(i * 21 + j, reopened.at(i, j));
+        }
+      }
+      std::remove(path.c_str());
+    }
+
+    TEST_F(MarsTest, TerrainReopensFromDisk) {
+      std::string path = "mars_test_terrain";
+      MARS::Terrain generated(16, 16, path);
+      MARS::Terrain reopened(16, 16, path);
+      for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+          EXPECT_EQ(generated.weightAtXY(i, j), reopened.weightAtXY(i, j));
+        }
+      }
+      std::remove((path + ".weights.mat").c_str());
+      std::remove((path + ".types.mat").c_str());
+    }
+
+    TEST_F(MarsTest, SharedMatrixCopiesOnWrite) {
+      MARS::SharedMatrix<int> original(50, 40, MARS::MATRIX_GRID);
+      original.at(3, 4) = 7;
+
+      std::size_t allocations = MARS::detail::allocationCount();
+      MARS::SharedMatrix<int> snapshot = original;
+      EXPECT_EQ(allocations, MARS::detail::allocationCount());
+      EXPECT_TRUE(original.isShared());
+      EXPECT_EQ(original.read().ptr(), snapshot.read().ptr());
+
+      // Writing clones the buffer once, and leaves the snapshot as it was
+      original.at(3, 4) = 8;
+      original.at(5, 6) = 9;
+      EXPECT_EQ(allocations + 1, MARS::detail::allocationCount());
+      EXPECT_FALSE(original.isShared());
+      EXPECT_EQ(8, original.at(3, 4));
+      EXPECT_EQ(9, original.at(5, 6));
+      const MARS::SharedMatrix<int>& read = snapshot;
+      EXPECT_EQ(7, read.at(3, 4));
+      EXPECT_EQ(0, read.at(5, 6));
+
+      // Terrain snapshots share their grids
+      MARS::Terrain terrain(32, 32);
+      allocations = MARS::detail::allocationCount();
+      MARS::Terrain terrain_copy = terrain;
+      EXPECT_EQ(allocations, MARS::detail::allocationCount());
+      EXPECT_EQ(terrain.weightView().rowPtr(0), terrain_copy.weightView().rowPtr(0));
+    }
+
+    TEST_F(MarsTest, FileBackedGameWritesAfterCopy) {
+      std::string prefix = "./population";
+      {
+        MARS::Game file_game(24, 24, 100, 100, 3.0, 200, 200, 200, 1.0, ".");
+        for (int i = 0; i < 10; i++)
+          file_game.step(false, MARS::Coord(0, 0));
+
+        // Snapshots take a heap copy, and the game keeps writing to its files
+        MARS::PopulationMatrix snapshot = file_game.popMatrixCopy();
+        for (int i = 0; i < 40; i++)
+          file_game.step(i % 4 == 0, MARS::Coord((i * 5) % 24, (i * 7) % 24));
+        const MARS::PopulationMatrix& live = file_game.popMatrixView();
+        EXPECT_NE(snapshot.unservicedTotal() + snapshot.servicedTotal(), live.unservicedTotal() + live.servicedTotal());
+
+        MARS::Matrix<MARS::PopCount> serviced = MARS::Matrix<MARS::PopCount>::openFile(prefix + ".serviced.mat");
+        MARS::Matrix<MARS::PopCount> unserviced = MARS::Matrix<MARS::PopCount>::openFile(prefix + ".unserviced.mat");
+        for (int i = 0; i < 24; i++) {
+          for (int j = 0; j < 24; j++) {
+            EXPECT_EQ(live.numberServicedAtCoord(MARS::Coord(i, j)), serviced.at(i, j));
+            EXPECT_EQ(live.numberUnservicedAtCoord(MARS::Coord(i, j)), unserviced.at(i, j));
+          }
+        }
+      }
+      std::remove((prefix + ".serviced.mat").c_str());
+      std::remove((prefix + ".unserviced.mat").c_str());
+      std::remove("./terrain.weights.mat");
+      std::remove("./terrain.types.mat");
+    }
+
+    TEST_F(MarsTest, SparseTileMatrixSkipsEmptyTiles) {
+      MARS::SparseTileMatrix<int, 8> sparse(20, 30);
+      EXPECT_EQ(12, sparse.numberTiles());
+      sparse.set(3, 4, 0);
+      EXPECT_EQ(0, sparse.numberAllocatedTiles());
+
+      sparse.at(19, 29) = 5;
+      MARS::Matrix<int> delta(20, 30);
+      delta.at(0, 0) = 2;
+      sparse.addAssign(delta);
+      // Reads through a const reference never allocate
+      const MARS::SparseTileMatrix<int, 8>& read = sparse;
+      EXPECT_EQ(2, read.at(0, 0));
+      EXPECT_EQ(5, read.at(19, 29));
+      EXPECT_EQ(0, read.at(10, 10));
+      EXPECT_EQ(2, sparse.numberAllocatedTiles());
+
+      int visited = 0;
+      for (MARS::SparseTileMatrix<int, 8>::TileRef tile : sparse.nonEmptyTiles()) {
+        visited++;
+        EXPECT_EQ(tile.row() + tile.numberRows() <= 20, true);
+        EXPECT_EQ(tile.col() + tile.numberCols() <= 30, true);
+      }
+      EXPECT_EQ(2, visited);
+
+      sparse.set(0, 0, 0);
+      sparse.releaseEmptyTiles();
+      EXPECT_EQ(1, sparse.numberAllocatedTiles());
+
+      MARS::PopulationMatrix dense_pop(20, 30);
+      MARS::PopulationMatrix sparse_pop(20, 30, "", true);
+      MARS::Matrix<MARS::PopCount> growth(20, 30);
+      growth.at(7, 25) = 3;
+      dense_pop.addUnservicedPop(growth);
+      sparse_pop.addUnservicedPop(growth);
+      EXPECT_EQ(dense_pop.unservicedTotal(), sparse_pop.unservicedTotal());
+      EXPECT_EQ(dense_pop.unservicedSumOfSquares(), sparse_pop.unservicedSumOfSquares());
+      EXPECT_EQ(3, sparse_pop.numberTotalAtCoord(MARS::Coord(7, 25)));
+      EXPECT_THROW(sparse_pop.unservicedPopView(), std::logic_error);
+    }
+
+
+    TEST_F(MarsTest, CoordMapMatchesUnorderedMap) {
+      // Coords far beyond 65536 used to collide in std::hash<Coord>
+      std::hash<MARS::Coord> hash;
+      EXPECT_NE(hash(MARS::Coord(0, 65536)), hash(MARS::Coord(1, 0)));
+
+      const int grid_cols[] = {0, 100};
+      for (int cols : grid_cols) {
+        MARS::CoordMap<int> map(cols);
+        MARS::CoordSet set(cols);
+        std::unordered_map<MARS::Coord, int> reference;
+        std::srand(7);
+        for (int i = 0; i < 5000; i++) {
+          MARS::Coord c(std::rand() % 100, std::rand() % 100);
+          if (std::rand() % 3 == 0) {
+            EXPECT_EQ(reference.erase(c), map.erase(c));
+            set.erase(c);
+          } else {
+            map[c] += i;
+            reference[c] += i;
+            EXPECT_EQ(reference.size(), map.size());
+            set.insert(c);
+          }
+        }
+        ASSERT_EQ(reference.size(), map.size());
+        ASSERT_EQ(reference.size(), set.size());
+        std::size_t visited = 0;
+        for (const std::pair<MARS::Coord, int>& element : map) {
+          EXPECT_EQ(reference.at(element.first), element.second);
+          EXPECT_EQ(1, set.count(element.first));
+          visited++;
+        }
+        EXPECT_EQ(reference.size(), visited);
+        EXPECT_EQ(0, map.count(MARS::Coord(-5, 100000)));
+        EXPECT_THROW(map.at(MARS::Coord(-5, 100000)), std::out_of_range);
+        EXPECT_FALSE(set.insert(map.begin()->first));
+      }
+    }
 
     TEST_F(MarsTest, GenerateServiceableAreaTest1_FlatLand) {
       MARS::Terrain terrain(4);
@@ -71,7 +576,7 @@ namespace {
       int y = 1;
       MARS::Plant plant(cap, servable_dist, x, y, terrain);
 
-      std::unordered_map<MARS::Coord, double> serviceableArea = plant.serviceableArea();
+      const MARS::CoverageStencil& serviceableArea = plant.serviceableArea();
       EXPECT_EQ(15, serviceableArea.size());
 
     }
@@ -86,7 +591,7 @@ namespace {
       int y = 1;
       MARS::Plant plant = MARS::Plant(cap, serv_dist, x, y, terrain);
 
-      std::unordered_map<MARS::Coord, double> serviceableArea = plant.serviceableArea();
+      const MARS::CoverageStencil& serviceableArea = plant.serviceableArea();
 
 
       EXPECT_EQ(4, serviceableArea.size());
@@ -103,7 +608,7 @@ namespace {
       int y = 1;
       MARS::Plant plant = MARS::Plant(cap, serv_dist, x, y, terrain);
 
-      std::unordered_map<MARS::Coord, double> serviceableArea = plant.serviceableArea();
+      const MARS::CoverageStencil& serviceableArea = plant.serviceableArea();
 
       EXPECT_EQ(10, serviceableArea.size());
 
@@ -118,9 +623,7 @@ namespace {
       int y = 1;
       MARS::Plant plant = MARS::Plant(cap, serv_dist, x, y, terrain);
 
-      std::unordered_map<MARS::Coord, double> serviceableArea = plant.serviceableArea();
-
-      std::unordered_map<MARS::Coord, int> servicedMap = plant.servicedMap();
+      const std::vector<int>& servicedMap = plant.servicedMap();
 
       EXPECT_EQ(10, servicedMap.size());
     }
@@ -135,7 +638,7 @@ namespace {
       int y = 1;
       MARS::Plant plant = MARS::Plant(cap, serv_dist, x, y, terrain);
 
-      std::unordered_map<MARS::Coord, double> serviceableArea = plant.serviceableArea();
+      const MARS::CoverageStencil& serviceableArea = plant.serviceableArea();
 
       EXPECT_EQ(0, serviceableArea.size());
     }
@@ -178,6 +681,292 @@ namespace {
       }
     }
 
+    TEST_F(MarsTest, BitMatrixBulkOps) {
+      int rows = 9;
+      int cols = 150; // Crosses word boundaries, with a partial last word
+      MARS::BitMatrix land(rows, cols);
+      MARS::BitMatrix plants(rows, cols);
+      land.fillRect(1, 10, 6, 130);
+      EXPECT_EQ(6 * 130, land.count());
+      EXPECT_EQ(130, land.countRow(3));
+      EXPECT_EQ(0, land.countRow(0));
+      land.clearRect(2, 60, 1, 8);
+      EXPECT_EQ(122, land.countRow(2));
+
+      plants.set(3, 64, true);
+      plants.set(3, 149, true);
+      plants.set(8, 0, true);
+
+      MARS::BitMatrix free_land = land;
+      free_land.andNot(plants);
+      MARS::BitMatrix both = land;
+      both &= plants;
+      MARS::BitMatrix either = land;
+      either |= plants;
+      MARS::BitMatrix one = land;
+      one ^= plants;
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          EXPECT_EQ(land.get(i, j) && !plants.get(i, j), free_land.get(i, j));
+          EXPECT_EQ(land.get(i, j) && plants.get(i, j), both.get(i, j));
+          EXPECT_EQ(land.get(i, j) || plants.get(i, j), either.get(i, j));
+          EXPECT_EQ(land.get(i, j) != plants.get(i, j), one.get(i, j));
+        }
+      }
+      EXPECT_EQ(1, both.count());
+      EXPECT_THROW(land &= MARS::BitMatrix(rows, cols + 1), std::invalid_argument);
+
+      std::vector<MARS::Coord> found;
+      for (int r = 0, c = 0; either.findNext(r, c); c++) {
+        found.push_back(MARS::Coord(r, c));
+      }
+      std::vector<MARS::Coord> expected;
+      for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+          if (either.get(i, j))
+            expected.push_back(MARS::Coord(i, j));
+        }
+      }
+      EXPECT_EQ(expected, found);
+      EXPECT_EQ(-1, either.findNextInRow(0, 0));
+      EXPECT_EQ(149, either.findNextInRow(3, 140));
+    }
+
+    TEST_F(MarsTest, ServiceableAreaMatchesDijkstra) {
+      typedef std::pair<double, MARS::Coord> Entry;
+      struct Later {
+        bool operator()(const Entry& a, const Entry& b) const { return a.first > b.first; }
+      };
+      const int rows[] = {40, 57, 23};
+      const int cols[] = {40, 31, 64};
+      const double serve_dists[] = {0.0, 7.0, 30.5, 150.0};
+
+      for (int t = 0; t < 3; t++) {
+        MARS::Terrain terrain(rows[t], cols[t]);
+        for (int p = 0; p < 4; p++) {
+          MARS::Coord source((p * 7 + 3) % rows[t], (p * 11 + 5) % cols[t]);
+          for (double serve_dist : serve_dists) {
+            // Reference: Dijkstra with a binary heap over the float weights
+            std::unordered_map<MARS::Coord, double> dist;
+            std::priority_queue<Entry, std::vector<Entry>, Later> heap;
+            dist[source] = 0.0;
+            heap.push(Entry(0.0, source));
+            while (!heap.empty()) {
+              Entry top = heap.top();
+              heap.pop();
+              if (top.first > dist[top.second])
+                continue;
+              const int dx[] = {0, 0, -1, 1};
+              const int dy[] = {-1, 1, 0, 0};
+              for (int n = 0; n < 4; n++) {
+                MARS::Coord next(top.second.x + dx[n], top.second.y + dy[n]);
+                if (next.x < 0 || next.y < 0 || next.x >= rows[t] || next.y >= cols[t])
+                  continue;
+                double d = top.first + terrain.weightAtXY(next.x, next.y);
+                if (d > serve_dist || (dist.count(next) && dist[next] <= d))
+                  continue;
+                dist[next] = d;
+                heap.push(Entry(d, next));
+              }
+            }
+            dist.erase(source);
+
+            MARS::Plant plant(10, serve_dist, source.x, source.y, terrain);
+            const MARS::CoverageStencil& area = plant.serviceableArea();
+            ASSERT_EQ(dist.size(), area.size());
+            for (const auto& element : dist) {
+              ASSERT_TRUE(plant.isServiceableCoord(element.first));
+              EXPECT_EQ(element.second, plant.distanceToCoord(element.first));
+            }
+          }
+        }
+      }
+    }
+
+    TEST_F(MarsTest, CoverageStencilLookups) {
+      // On all-grass terrain the serviceable area is a diamond of Manhattan distances
+      MARS::Terrain terrain(128, 96, false);
+      MARS::Plant plant(10, 40.0, 60, 50, terrain);
+      const MARS::CoverageStencil& area = plant.serviceableArea();
+      EXPECT_EQ(2u * 40 * 41, area.size());
+
+      std::size_t position = 0;
+      for (int x = 0; x < 128; x++) {
+        for (int y = 0; y < 96; y++) {
+          int dist = std::abs(x - 60) + std::abs(y - 50);
+          int found = area.find(MARS::Coord(x, y));
+          if (dist == 0 || dist > 40) {
+            EXPECT_EQ(-1, found);
+            continue;
+          }
+          // Positions follow row-major cell order
+          ASSERT_EQ((int) position, found);
+          EXPECT_EQ(MARS::Coord(x, y), area.coordAt(position));
+          EXPECT_EQ(dist, area.distanceAt(position));
+          position++;
+        }
+      }
+      EXPECT_EQ(-1, area.find(MARS::Coord(60, -1)));
+      EXPECT_EQ(-1, area.find(MARS::Coord(-5, 50)));
+
+      plant.changeServicedPop(MARS::Coord(61, 50), 3);
+      EXPECT_EQ(3, plant.numberServicedAtCoord(MARS::Coord(61, 50)));
+      EXPECT_EQ(3, plant.servicedMap()[area.find(MARS::Coord(61, 50))]);
+      EXPECT_THROW(plant.distanceToCoord(MARS::Coord(0, 0)), std::out_of_range);
+
+      // Indices and distances take 8 bytes a cell, plus the row index
+      EXPECT_LE(area.shape()->memoryUsage(), area.size() * 8 + 96 * 4 + sizeof(MARS::CoverageShape));
+    }
+
+    TEST_F(MarsTest, UniformGrassSharesStencils) {
+      MARS::Terrain flat(64);
+      MARS::Plant a(10, 12.0, 20, 20, flat);
+      MARS::Plant b(10, 12.5, 40, 30, flat);
+      EXPECT_TRUE(a.serviceableArea().shape()->interned());
+      EXPECT_EQ(a.serviceableArea().shape(), b.serviceableArea().shape());
+      EXPECT_EQ(0u, a.serviceableArea().memoryUsage());
+      EXPECT_EQ(12.0, b.distanceToCoord(MARS::Coord(46, 24)));
+      EXPECT_FALSE(b.isServiceableCoord(MARS::Coord(46, 23)));
+
+      // Areas clipped by the edge, or reaching water, are searched for
+      MARS::Plant edge(10, 12.0, 5, 20, flat);
+      EXPECT_FALSE(edge.serviceableArea().shape()->interned());
+      MARS::Terrain water(32, 32, true);
+      MARS::Plant near_water(10, 4.0, 3, 3, water);
+      MARS::Plant far_from_water(10, 4.0, 9, 9, water);
+      EXPECT_FALSE(near_water.serviceableArea().shape()->interned());
+      EXPECT_TRUE(far_from_water.serviceableArea().shape()->interned());
+      EXPECT_EQ(3.0, near_water.distanceToCoord(MARS::Coord(0, 3)));
+      EXPECT_FALSE(near_water.isServiceableCoord(MARS::Coord(1, 1)));
+    }
+
+    TEST_F(MarsTest, CoverageCacheReusesAreas) {
+      MARS::Terrain terrain(64, 64, false);
+      MARS::CoverageCache cache;
+      MARS::CoverageCache::StencilPtr first = cache.get(terrain, MARS::Coord(20, 20), 10.0);
+      EXPECT_EQ(0u, cache.hits());
+      EXPECT_EQ(1u, cache.misses());
+
+      // Copies of a terrain share its id, so they share areas
+      MARS::Terrain copy = terrain;
+      EXPECT_EQ(first, cache.get(copy, MARS::Coord(20, 20), 10.0));
+      EXPECT_EQ(1u, cache.hits());
+
+      // Another distance, location or terrain is a different area
+      EXPECT_NE(first, cache.get(terrain, MARS::Coord(20, 20), 11.0));
+      EXPECT_NE(first, cache.get(terrain, MARS::Coord(21, 20), 10.0));
+      MARS::Terrain other(64, 64, false);
+      EXPECT_NE(other.generationId(), terrain.generationId());
+      EXPECT_NE(first, cache.get(other, MARS::Coord(20, 20), 10.0));
+      EXPECT_EQ(4u, cache.misses());
+      EXPECT_EQ(4u, cache.size());
+
+      // Over budget, the least recently used areas go first
+      cache.get(terrain, MARS::Coord(20, 20), 10.0);
+      cache.setCapacity(cache.memoryUsage() / 2);
+      EXPECT_GT(cache.evictions(), 0u);
+      std::size_t misses = cache.misses();
+      EXPECT_EQ(first, cache.get(terrain, MARS::Coord(20, 20), 10.0));
+      EXPECT_EQ(misses, cache.misses());
+      cache.get(terrain, MARS::Coord(21, 20), 10.0);
+      EXPECT_EQ(misses + 1, cache.misses());
+
+      // Plants at one spot share a single area through the shared cache
+      MARS::Plant a(10, 10.0, 30, 30, terrain);
+      MARS::Plant b(20, 10.0, 30, 30, copy);
+      EXPECT_EQ(&a.serviceableArea(), &b.serviceableArea());
+    }
+
+    TEST_F(MarsTest, CoverageIndexMatchesScan) {
+      MARS::Terrain terrain(40, 40);
+      MARS::PlantPool plants;
+      std::vector<MARS::PlantHandle> handles;
+      MARS::CoverageIndex index(40, 40, plants);
+      for (int p = 0; p < 12; p++) {
+        handles.push_back(plants.create(MARS::Coord((p * 13) % 40, (p * 7 + p / 3) % 40), 3, 12.0, terrain));
+        index.addPlant(handles.back());
+      }
+
+      // Nearest plant with room, the earliest added on ties, as Game used to scan for
+      auto scan = [&plants, &handles](const MARS::Coord& c) {
+        MARS::PlantHandle best;
+        for (MARS::PlantHandle plant : handles) {
+          if (plants.isServiceableCoord(plant, c) && plants.remainingCapacity(plant) > 0
+              && (best.isNull() || plants.distanceToCoord(plant, c) < plants.distanceToCoord(best, c)))
+            best = plant;
+        }
+        return best;
+      };
+
+      // Fill plants up cell by cell, checking every cell after each assignment
+      for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 40; i++) {
+          for (int j = 0; j < 40; j++) {
+            MARS::Coord c(i, j);
+            MARS::PlantHandle best = index.bestPlant(c);
+            ASSERT_TRUE(scan(c) == best);
+            if (!best.isNull() && (i + j) % 3 == 0)
+              plants.changeServicedPop(best, c, 1);
+          }
+        }
+        // Freeing capacity makes full plants candidates again
+        for (MARS::PlantHandle plant : handles) {
+          const MARS::CoverageStencil& area = plants.serviceableArea(plant);
+          for (std::size_t k = 0; k < area.size(); k++) {
+            int served = plants.numberServicedAtCoord(plant, area.coordAt(k));
+            if (served > 0)
+              plants.changeServicedPop(plant, area.coordAt(k), -served);
+          }
+        }
+        index.capacityFreed();
+      }
+
+      for (int i = 0; i < 40; i++) {
+        for (int j = 0; j < 40; j++) {
+          int covering = 0;
+          for (MARS::PlantHandle plant : handles)
+            covering += plants.isServiceableCoord(plant, MARS::Coord(i, j));
+          EXPECT_EQ(covering, index.numberCovering(MARS::Coord(i, j)));
+        }
+      }
+    }
+
+    TEST_F(MarsTest, PlantPoolHandles) {
+      MARS::Terrain terrain(32, 32, false);
+      MARS::PlantPool plants;
+      MARS::PlantHandle a = plants.create(MARS::Coord(10, 10), 50, 4.0, terrain);
+      MARS::PlantHandle b = plants.create(MARS::Coord(20, 20), 60, 4.0, terrain);
+      EXPECT_EQ(0u, a.id);
+      EXPECT_EQ(1u, b.id);
+      EXPECT_EQ(2u, plants.size());
+
+      plants.changeServicedPop(b, MARS::Coord(21, 21), 7);
+      EXPECT_EQ(53, plants.remainingCapacity(b));
+      EXPECT_EQ(7, plants.numberServicedAtCoord(b, MARS::Coord(21, 21)));
+      EXPECT_EQ(2.0, plants.distanceToCoord(b, MARS::Coord(21, 21)));
+      EXPECT_THROW(plants.changeServicedPop(b, MARS::Coord(0, 0), 1), std::out_of_range);
+
+      // State is plain arrays indexed by id
+      EXPECT_EQ(MARS::Coord(20, 20), plants.locationArray()[b.id]);
+      EXPECT_EQ(7, plants.inServiceArray()[b.id]);
+
+      // A removed plant's handle goes stale, even once its id is reused
+      plants.remove(a);
+      EXPECT_FALSE(plants.contains(a));
+      EXPECT_THROW(plants.location(a), std::out_of_range);
+      MARS::PlantHandle c = plants.create(MARS::Coord(5, 5), 10, 4.0, terrain);
+      EXPECT_EQ(a.id, c.id);
+      EXPECT_TRUE(a != c);
+      EXPECT_FALSE(plants.contains(a));
+      EXPECT_EQ(0, plants.numberServicedAtCoord(c, MARS::Coord(5, 6)));
+
+      std::vector<MARS::Coord> visited;
+      plants.forEach([&](MARS::PlantHandle p) { visited.push_back(plants.location(p)); });
+      ASSERT_EQ(2u, visited.size());
+      EXPECT_EQ(MARS::Coord(5, 5), visited[0]);
+      EXPECT_EQ(MARS::Coord(20, 20), visited[1]);
+    }
+
     TEST_F(MarsTest, TerrainGen) {
       MARS::Terrain terrain(8, 8);
       for (int i = 0; i < 8; i++) {
@@ -197,16 +986,17 @@ namespace {
     TEST_F(MarsTest, PopulationMatrixServicedByPlant) {
       // sum up all plants, check that it's equal to total num serviced
       MARS::Terrain terrain(8, 8);
-      MARS::Plant p1(100, 5, 2, 3, terrain);
-      MARS::Plant p2(100, 3, 4, 4, terrain);
+      MARS::PlantPool plants;
+      MARS::PlantHandle p1 = plants.create(MARS::Coord(2, 3), 100, 5, terrain);
+      MARS::PlantHandle p2 = plants.create(MARS::Coord(4, 4), 100, 3, terrain);
       MARS::Coord c(2, 3);
 
-      popMat.assignUnservicedPop(&p1, c, 5);
-      popMat.assignUnservicedPop(&p2, c, 10);
+      popMat.assignUnservicedPop(p1, c, 5);
+      popMat.assignUnservicedPop(p2, c, 10);
 
       EXPECT_EQ(
               popMat.numberServicedAtCoord(c),
-              popMat.numberServicedAtCoordByPlant(c, &p1) + popMat.numberServicedAtCoordByPlant(c, &p2)
+              popMat.numberServicedAtCoordByPlant(c, p1) + popMat.numberServicedAtCoordByPlant(c, p2)
       );
     }
 
@@ -215,20 +1005,21 @@ namespace {
       // check that population for plant 'from' has decreased by x
       // and that population for plant 'to' has increased by x
       MARS::Terrain terrain(8, 8);
-      MARS::Plant p1(100, 5, 2, 3, terrain);
-      MARS::Plant p2(100, 3, 4, 4, terrain);
+      MARS::PlantPool plants;
+      MARS::PlantHandle p1 = plants.create(MARS::Coord(2, 3), 100, 5, terrain);
+      MARS::PlantHandle p2 = plants.create(MARS::Coord(4, 4), 100, 3, terrain);
       MARS::Coord c(2, 3);
 
-      popMat.assignUnservicedPop(&p1, c, 5);
-      popMat.assignUnservicedPop(&p2, c, 10);
+      popMat.assignUnservicedPop(p1, c, 5);
+      popMat.assignUnservicedPop(p2, c, 10);
 
-      int oldPop1 = popMat.numberServicedAtCoordByPlant(c, &p1);
-      int oldPop2 = popMat.numberServicedAtCoordByPlant(c, &p2);
+      int oldPop1 = popMat.numberServicedAtCoordByPlant(c, p1);
+      int oldPop2 = popMat.numberServicedAtCoordByPlant(c, p2);
 
-      popMat.moveServicedPopBetweenPlants(&p2, &p1, c, 5);
+      popMat.moveServicedPopBetweenPlants(p2, p1, c, 5);
 
-      int newPop1 = popMat.numberServicedAtCoordByPlant(c, &p1);
-      int newPop2 = popMat.numberServicedAtCoordByPlant(c, &p2);
+      int newPop1 = popMat.numberServicedAtCoordByPlant(c, p1);
+      int newPop2 = popMat.numberServicedAtCoordByPlant(c, p2);
 
       EXPECT_EQ(
               newPop1, oldPop1 + 5
@@ -238,11 +1029,137 @@ namespace {
       );
     }
 
+    TEST_F(MarsTest, PopulationTotalsKeptUpToDate) {
+      MARS::Terrain terrain(40, 40);
+      MARS::PlantPool plants;
+      MARS::PlantHandle p1 = plants.create(MARS::Coord(5, 5), 100, 8, terrain);
+      MARS::PlantHandle p2 = plants.create(MARS::Coord(30, 30), 100, 8, terrain);
+      MARS::PopulationMatrix dense(40, 40);
+      MARS::PopulationMatrix sparse(40, 40, "", true);
+      MARS::Matrix<MARS::PopCount> people(40, 40);
+      for (int i = 0; i < 40; i++)
+        people.at(i, (i * 7) % 40) = (MARS::PopCount) (i + 1);
+
+      for (MARS::PopulationMatrix* pops : {&dense, &sparse}) {
+        pops->addUnservicedPop(people);
+        pops->addUnservicedPop(pops->unservicedPop() * 2);
+        MARS::PopulationMatrix snapshot = *pops;
+        pops->assignUnservicedPop(p1, MARS::Coord(3, 21), 5);
+        pops->assignUnservicedPop(p2, MARS::Coord(30, 10), 50); // More than live there
+        pops->moveServicedPopBetweenPlants(p1, p2, MARS::Coord(3, 21), 2);
+
+        EXPECT_TRUE(pops->totalsConsistent());
+        EXPECT_TRUE(snapshot.totalsConsistent());
+        EXPECT_EQ(MARS::sum(pops->unservicedPop()), pops->unservicedTotal());
+        EXPECT_EQ(MARS::sum(pops->servicedPop()), pops->servicedTotal());
+        EXPECT_EQ(MARS::sum(pops->unservicedPop() * pops->unservicedPop()), pops->unservicedSumOfSquares());
+        EXPECT_EQ(MARS::sum(people) * 3, snapshot.unservicedTotal());
+      }
+      EXPECT_EQ(dense.unservicedTotal(), sparse.unservicedTotal());
+
+      // Stepping a game keeps them too, under both assignment engines
+      MARS::Game flow_game(24, 24, 100, 100, 3.0, 200, 200, 200, 1.0);
+      flow_game.setAssignmentEngine(MARS::MIN_COST_FLOW_ASSIGNMENT);
+      for (MARS::Game* g : {&game, &flow_game}) {
+        for (int i = 0; i < 40; i++) {
+          g->step(i % 4 == 0, MARS::Coord((i * 5) % g->sizeX(), (i * 3) % g->sizeY()));
+          ASSERT_TRUE(g->popMatrixView().totalsConsistent());
+        }
+      }
+    }
+
+    TEST_F(MarsTest, PotentialPopVisitor) {
+      MARS::Terrain terrain(40, 40);
+      MARS::PlantPool plants;
+      MARS::PlantHandle near = plants.create(MARS::Coord(10, 10), 100, 8, terrain);
+      MARS::PlantHandle far = plants.create(MARS::Coord(14, 10), 100, 30, terrain);
+      MARS::PopulationMatrix pops(40, 40);
+      MARS::Matrix<MARS::PopCount> people(40, 40);
+      people.at(11, 10) = 7;
+      pops.addUnservicedPop(people);
+      pops.assignUnservicedPop(far, MARS::Coord(11, 10), 4);
+
+      MARS::CoordMap<std::pair<int, std::unordered_map<MARS::PlantHandle, int>>> expected = pops.potentialPopForPlant(plants, near);
+      std::size_t visited = 0;
+      pops.forEachPotentialPop(plants, near, [&](const MARS::Coord& c, double distance, int unserviced,
+                                                const std::vector<MARS::PlantServing>& farther) {
+        visited++;
+        EXPECT_EQ(plants.distanceToCoord(near, c), distance);
+        EXPECT_EQ(expected.at(c).first, unserviced);
+        EXPECT_EQ(expected.at(c).second.size(), farther.size());
+        for (const MARS::PlantServing& serving : farther) {
+          EXPECT_GT(serving.distance, distance);
+          EXPECT_EQ(expected.at(c).second.at(serving.plant), serving.count);
+        }
+      });
+      EXPECT_EQ(plants.serviceableArea(near).size(), visited);
+
+      if (plants.isServiceableCoord(near, MARS::Coord(11, 10))
+          && plants.distanceToCoord(far, MARS::Coord(11, 10)) > plants.distanceToCoord(near, MARS::Coord(11, 10))) {
+        EXPECT_EQ(3, expected.at(MARS::Coord(11, 10)).first);
+        EXPECT_EQ(4, expected.at(MARS::Coord(11, 10)).second.at(far));
+      }
+    }
+
+    TEST_F(MarsTest, PlantAssignmentsOverflow) {
+      MARS::Terrain terrain(8, 8);
+      MARS::PlantPool plants;
+      std::vector<MARS::PlantHandle> handles;
+      for (int i = 0; i < 4; i++)
+        handles.push_back(plants.create(MARS::Coord(i, i), 100, 5, terrain));
+
+      MARS::PlantAssignments assignments(1024, 1024);
+      // One inline entry per cell, rather than a hash map
+      EXPECT_LE(assignments.memoryUsage(), 1024u * 1024u * 16u + 64u);
+
+      for (int i = 0; i < 4; i++)
+        assignments.add(3, 5, handles[i], i + 1);
+      assignments.add(3, 5, handles[2], 10);
+      assignments.add(3, 5, handles[0], -1);
+
+      MARS::PlantAssignments snapshot = assignments;
+      assignments.add(3, 5, handles[3], 100);
+
+      EXPECT_EQ(0, assignments.count(3, 5, handles[0]));
+      EXPECT_EQ(2, assignments.count(3, 5, handles[1]));
+      EXPECT_EQ(13, assignments.count(3, 5, handles[2]));
+      EXPECT_EQ(104, assignments.count(3, 5, handles[3]));
+      EXPECT_EQ(4, snapshot.count(3, 5, handles[3]));
+      EXPECT_EQ(0, assignments.count(5, 3, handles[1]));
+
+      std::vector<int> counts;
+      assignments.forEachAt(3, 5, [&](MARS::PlantHandle, int count) { counts.push_back(count); });
+      EXPECT_EQ(std::vector<int>({0, 2, 13, 104}), counts);
+
+      // A removed plant's successor in the same slot starts with nothing
+      plants.remove(handles[1]);
+      MARS::PlantHandle successor = plants.create(MARS::Coord(6, 6), 100, 5, terrain);
+      EXPECT_EQ(handles[1].id, successor.id);
+      EXPECT_EQ(0, assignments.count(3, 5, successor));
+    }
 
     TEST_F(MarsTest, InitializationTest) {
       MARS::Game game2(8, 8, 1, 100, 50, 200, 200, 200, 1.0);
       EXPECT_EQ(game2.numberPlantsInService(), 0);
     }
+
+    TEST_F(MarsTest, NonSquareGameState) {
+      MARS::Game game2(20, 50, 10, 100, 5, 200, 200, 200, 1.0);
+      for (int i = 0; i < 5; i++)
+        game2.step(i == 0, MARS::Coord(17, 43));
+      const MARS::Game::RLState& state = game2.rlState;
+      const MARS::Matrix<MARS::PopCount>* layers[3] = {&state.totalPops, &state.unservicedPops, &state.servicedPops};
+      for (const MARS::Matrix<MARS::PopCount>* layer : layers) {
+        EXPECT_EQ(20u, layer->numberRows());
+        EXPECT_EQ(50u, layer->numberCols());
+      }
+      EXPECT_EQ(20u, state.terrain.numberRows());
+      EXPECT_EQ(50u, state.terrain.numberCols());
+      EXPECT_EQ(20u, state.plantLocs.numberRows());
+      EXPECT_EQ(50u, state.plantLocs.numberCols());
+      EXPECT_EQ(game2.isPlantPresent(MARS::Coord(17, 43)), state.plantLocs.at(17, 43));
+      EXPECT_EQ(game2.numberUnservicedPop(), MARS::sum(state.unservicedPops));
+    }
     // Q: are NULLs the best way to pass in nonexistent coords?
 
 
@@ -261,6 +1178,27 @@ namespace {
     }
 
 
+    TEST_F(MarsTest, StepDoesNotAllocate) {
+      // Once warmed up, stepping without placing a plant should not touch the heap
+      MARS::Game game1(32, 32, 2000, 100, 5, 200, 200, 200, 1.0);
+      for (int i = 0; i < 20; i++) {
+        game1.step(false, MARS::Coord(0, 0));
+      }
+
+      std::size_t heap_before = heap_allocations;
+      std::size_t matrix_before = MARS::detail::allocationCount();
+      for (int i = 0; i < 1000; i++) {
+        game1.step(false, MARS::Coord(0, 0));
+      }
+      std::size_t heap_after = heap_allocations;
+      std::size_t matrix_after = MARS::detail::allocationCount();
+
+      EXPECT_EQ(heap_before, heap_after);
+      EXPECT_EQ(matrix_before, matrix_after);
+      EXPECT_EQ(game1.currentTime(), 1020);
+    }
+
+
     /* Q: what is in the first element of the pair when there is no plant? (cannot be NULL as NULL is numeric) */
 
     // Commenting this test out for now
@@ -308,6 +1246,112 @@ namespace {
 
 
 
+    TEST_F(MarsTest, PlantPlacementValidation) {
+      MARS::Terrain terrain(8, 8, true); // Grassland, with water around (1, 1)
+      MARS::Game game1(terrain, 10, 100, 3, 200, 200, 200, 1.0);
+
+      EXPECT_FALSE(game1.canPlacePlant(MARS::Coord(8, 2)));
+      EXPECT_FALSE(game1.canPlacePlant(MARS::Coord(-1, 2)));
+      EXPECT_FALSE(game1.canPlacePlant(MARS::Coord(1, 2)));
+      EXPECT_TRUE(game1.canPlacePlant(MARS::Coord(1, 1)));
+      EXPECT_FALSE(game1.isPlantPresent(MARS::Coord(9, 9)));
+
+      game1.step(true, MARS::Coord(9, 9));
+      game1.step(true, MARS::Coord(2, 6));
+      EXPECT_EQ(1u, game1.plants().size());
+      EXPECT_TRUE(game1.isPlantPresent(MARS::Coord(2, 6)));
+      EXPECT_FALSE(game1.isPlantPresent(MARS::Coord(6, 2)));
+      EXPECT_FALSE(game1.canPlacePlant(MARS::Coord(2, 6)));
+      EXPECT_EQ(MARS::Coord(2, 6), game1.plants().location(game1.plantAt(MARS::Coord(2, 6))));
+      EXPECT_THROW(game1.createPlant(MARS::Coord(2, 6)), std::invalid_argument);
+      EXPECT_TRUE(game1.rlState.plantLocs.at(2, 6));
+      EXPECT_FALSE(game1.rlState.plantLocs.at(6, 2));
+    }
+
+    TEST_F(MarsTest, ActiveCellsLeaveNoReachablePopulation) {
+      // After each step, no unserviced person may be reachable by a plant with room
+      MARS::Terrain terrain(48, 48);
+      MARS::Game game1(terrain, 100, 60, 6, 200, 200, 200, 1.0);
+      for (int t = 0; t < 40; t++) {
+        MARS::Coord plant_loc((t * 11) % 48, (t * 17) % 48);
+        game1.step(t % 4 == 0, plant_loc);
+        if (t % 4 == 0)
+          continue; // Placing a plant processes its area separately
+        const MARS::PopulationMatrix& pops = game1.popMatrixView();
+        for (int i = 0; i < 48; i++) {
+          for (int j = 0; j < 48; j++) {
+            if (pops.numberUnservicedAtCoord(MARS::Coord(i, j)) > 0) {
+              EXPECT_FALSE(game1.findBestPlant(MARS::Coord(i, j)).second) << i << "," << j << " at " << t;
+            }
+          }
+        }
+      }
+      EXPECT_GT(game1.plants().size(), 0u);
+    }
+
+    TEST_F(MarsTest, AssignmentFlowIsOptimal) {
+      MARS::Terrain flat(16);
+      MARS::PlantPool plants;
+      MARS::PlantHandle a = plants.create(MARS::Coord(5, 5), 10, 4, flat);
+      MARS::PlantHandle b = plants.create(MARS::Coord(5, 9), 10, 4, flat);
+      MARS::PopulationMatrix pops(16, 16);
+      MARS::Matrix<MARS::PopCount> people(16, 16);
+      people.at(5, 8) = 10; // 3 from a, 1 from b
+      people.at(5, 11) = 10; // Only b, 2 away, reaches
+      pops.addUnservicedPop(people);
+
+      // Greedily, (5, 8) goes to the nearest plant, leaving no room for (5, 11)
+      pops.assignUnservicedPop(b, MARS::Coord(5, 8), 10);
+      plants.changeServicedPop(b, MARS::Coord(5, 8), 10);
+
+      MARS::AssignmentFlow flow(16, 16);
+      EXPECT_EQ(10, flow.solve(plants, pops));
+      EXPECT_EQ(10, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 8), a));
+      EXPECT_EQ(0, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 8), b));
+      EXPECT_EQ(10, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 11), b));
+      EXPECT_EQ(0, pops.unservicedTotal());
+
+      // Too many people now, so the cheapest way to serve 20 of them is
+      // a: 5 at (5, 6) and 5 at (5, 8), b: 5 at (5, 8) and 5 at (5, 11)
+      MARS::Matrix<MARS::PopCount> growth(16, 16);
+      growth.at(5, 6) = 5;
+      pops.addUnservicedPop(growth);
+      EXPECT_EQ(0, flow.solve(plants, pops));
+      EXPECT_EQ(5, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 6), a));
+      EXPECT_EQ(5, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 8), a));
+      EXPECT_EQ(5, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 8), b));
+      EXPECT_EQ(5, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 11), b));
+      EXPECT_EQ(5, pops.numberUnservicedAtCoord(MARS::Coord(5, 11)));
+      EXPECT_EQ(0, plants.remainingCapacity(a));
+      EXPECT_EQ(0, plants.remainingCapacity(b));
+      EXPECT_TRUE(pops.totalsConsistent());
+
+      // Already optimal, so solving again changes nothing
+      EXPECT_EQ(0, flow.solve(plants, pops));
+      EXPECT_EQ(5, pops.numberServicedAtCoordByPlant(MARS::Coord(5, 8), b));
+    }
+
+    TEST_F(MarsTest, AssignmentFlowEngineInGame) {
+      MARS::Terrain terrain(48, 48);
+      MARS::Game game1(terrain, 100, 60, 6, 200, 200, 200, 1.0);
+      game1.setAssignmentEngine(MARS::MIN_COST_FLOW_ASSIGNMENT);
+      EXPECT_EQ(MARS::MIN_COST_FLOW_ASSIGNMENT, game1.assignmentEngine());
+      for (int t = 0; t < 40; t++) {
+        game1.step(t % 4 == 0, MARS::Coord((t * 11) % 48, (t * 17) % 48));
+        const MARS::PopulationMatrix& pops = game1.popMatrixView();
+        EXPECT_EQ(pops.servicedTotal(), game1.numberServicedPop());
+        // Serving as many as possible leaves no one a plant with room could reach
+        for (int i = 0; i < 48; i++) {
+          for (int j = 0; j < 48; j++) {
+            if (pops.numberUnservicedAtCoord(MARS::Coord(i, j)) > 0) {
+              EXPECT_FALSE(game1.findBestPlant(MARS::Coord(i, j)).second) << i << "," << j << " at " << t;
+            }
+          }
+        }
+      }
+      EXPECT_GT(game1.plants().size(), 0u);
+    }
+
   TEST_F(MarsTest, UnservicedPopulationProcessed) {
     // check to see that number in service goes up over time
     for(int i = 0; i < 15; i++) {
@@ -333,7 +1377,13 @@ namespace {
         }
     }
     EXPECT_FALSE(std::isnan(game.calculateObjective()));
-    EXPECT_NE(game.calculateObjective(), 0);
+    // Plants are only built on land, and with a margin equal to the operating
+    // cost the objective can come out to exactly zero, so check the formula
+    EXPECT_GT(game.numberPlantsInService(), 0);
+    double expected = 200.0 * game.numberServicedPop()
+      - 200.0 * game.numberPlantsInService()
+      - 1.0 * game.numberUnservicedPop();
+    EXPECT_DOUBLE_EQ(expected, game.calculateObjective());
   }
 
 }
@@ -0,0 +1,305 @@
+#include "../include/AssignmentFlow.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+using namespace MARS;
+
+const std::int64_t AssignmentFlow::UNSERVICED_COST;
+
+static const std::uint32_t NO_EDGE = std::numeric_limits<std::uint32_t>::max();
+static const std::uint32_t SINK = 0;
+static const std::int64_t UNKNOWN_POTENTIAL = std::numeric_limits<std::int64_t>::min();
+static const std::int64_t UNREACHED = std::numeric_limits<std::int64_t>::max();
+
+AssignmentFlow::AssignmentFlow(int rows, int cols):
+  node_of_cell(rows, cols),
+  cell_potential(rows, cols),
+  number_phases(0)
+{
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++)
+      cell_potential.at(i, j) = UNKNOWN_POTENTIAL;
+  }
+}
+
+std::uint32_t AssignmentFlow::addNode() {
+  first_edge.push_back(NO_EDGE);
+  return (std::uint32_t) first_edge.size() - 1;
+}
+
+void AssignmentFlow::addEdge(std::uint32_t from, std::uint32_t to, std::int64_t cap, std::int64_t cost, std::int64_t flow) {
+  edges.push_back(Edge{to, first_edge[from], cap, cost});
+  first_edge[from] = (std::uint32_t) edges.size() - 1;
+  edges.push_back(Edge{from, first_edge[to], flow, -cost});
+  first_edge[to] = (std::uint32_t) edges.size() - 1;
+}
+
+std::int64_t AssignmentFlow::reducedCost(std::uint32_t e) const {
+  return edges[e].cost + potential[edges[e ^ 1].to] - potential[edges[e].to];
+}
+
+void AssignmentFlow::buildNetwork(const PlantPool& plants, const PopulationMatrix& pops) {
+  // Forget the cells of the last network, even if that solve threw
+  for (const Coord& c : cell_of_node)
+    node_of_cell.at(c.x, c.y) = 0;
+  edges.clear();
+  first_edge.clear();
+  plant_of_node.clear();
+  cell_of_node.clear();
+  node_of_plant.assign(plants.numberSlots(), NO_EDGE);
+  addNode(); // The sink
+
+  plants.forEach([this](PlantHandle plant) {
+    node_of_plant[plant.id] = addNode();
+    plant_of_node.push_back(plant);
+  });
+
+  // People at a cell flow to the plants covering it, as they are assigned now
+  plants.forEach([&](PlantHandle plant) {
+    const CoverageStencil& area = plants.serviceableArea(plant);
+    for (std::size_t i = 0; i < area.size(); i++) {
+      Coord c = area.coordAt(i);
+      int total = pops.numberTotalAtCoord(c);
+      if (total == 0)
+        continue;
+      std::uint32_t& node = node_of_cell.at(c.x, c.y);
+      if (node == 0) {
+        node = addNode();
+        cell_of_node.push_back(c);
+      }
+      int served = pops.numberServicedAtCoordByPlant(c, plant);
+      addEdge(node, node_of_plant[plant.id], total - served, (std::int64_t) area.distanceAt(i), served);
+    }
+  });
+
+  // The rest flow straight to the sink, unserviced
+  for (const Coord& c : cell_of_node) {
+    int unserviced = pops.numberUnservicedAtCoord(c);
+    addEdge(node_of_cell.at(c.x, c.y), SINK, pops.numberTotalAtCoord(c) - unserviced, UNSERVICED_COST, unserviced);
+  }
+  for (PlantHandle plant : plant_of_node) {
+    int remaining = plants.remainingCapacity(plant);
+    addEdge(node_of_plant[plant.id], SINK, remaining, 0, plants.capacity(plant) - remaining);
+  }
+
+  excess.assign(first_edge.size(), 0);
+}
+
+void AssignmentFlow::guessPotentials() {
+  const std::uint32_t first_cell = 1 + (std::uint32_t) plant_of_node.size();
+  potential.assign(first_edge.size(), UNKNOWN_POTENTIAL);
+  potential[SINK] = 0;
+  if (plant_potential.size() < node_of_plant.size())
+    plant_potential.resize(node_of_plant.size(), UNKNOWN_POTENTIAL);
+  for (std::uint32_t n = 1; n < first_cell; n++)
+    potential[n] = plant_potential[plant_of_node[n - 1].id];
+
+  // New cells start where their edges to the sink and known plants have no
+  // negative reduced cost, so only the edges that changed need repairs
+  for (std::uint32_t n = first_cell; n < first_edge.size(); n++) {
+    const Coord& c = cell_of_node[n - first_cell];
+    potential[n] = cell_potential.at(c.x, c.y);
+    if (potential[n] != UNKNOWN_POTENTIAL)
+      continue;
+    std::int64_t guess = potential[SINK] - UNSERVICED_COST;
+    for (std::uint32_t e = first_edge[n]; e != NO_EDGE; e = edges[e].next) {
+      std::int64_t plant = potential[edges[e].to];
+      if (edges[e].to != SINK && plant != UNKNOWN_POTENTIAL)
+        guess = std::max(guess, plant - edges[e].cost);
+    }
+    potential[n] = guess;
+  }
+
+  // New plants start as close as they can to the cells they cover
+  for (std::uint32_t n = 1; n < first_cell; n++) {
+    if (potential[n] != UNKNOWN_POTENTIAL)
+      continue;
+    std::int64_t guess = potential[SINK];
+    bool covers = false;
+    for (std::uint32_t e = first_edge[n]; e != NO_EDGE; e = edges[e].next) {
+      if (edges[e].to == SINK)
+        continue;
+      std::int64_t reach = potential[edges[e].to] - edges[e].cost; // Cell potential + distance
+      guess = covers ? std::min(guess, reach) : reach;
+      covers = true;
+    }
+    potential[n] = guess;
+  }
+}
+
+void AssignmentFlow::saturateNegativeEdges() {
+  for (std::uint32_t e = 0; e < edges.size(); e++) {
+    if (edges[e].cap > 0 && reducedCost(e) < 0) {
+      std::int64_t amount = edges[e].cap;
+      edges[e].cap = 0;
+      edges[e ^ 1].cap += amount;
+      excess[edges[e].to] += amount;
+      excess[edges[e ^ 1].to] -= amount;
+    }
+  }
+}
+
+void AssignmentFlow::shortestPaths() {
+  typedef std::pair<std::int64_t, std::uint32_t> Entry;
+  dist.assign(first_edge.size(), UNREACHED);
+  heap.clear();
+  for (std::uint32_t n = 0; n < excess.size(); n++) {
+    if (excess[n] > 0) {
+      dist[n] = 0;
+      heap.push_back(Entry(0, n));
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), std::greater<Entry>());
+
+  std::int64_t nearest_deficit = UNREACHED;
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+    Entry top = heap.back();
+    heap.pop_back();
+    std::uint32_t u = top.second;
+    if (top.first > dist[u])
+      continue;
+    if (excess[u] < 0) {
+      nearest_deficit = top.first;
+      break;
+    }
+    for (std::uint32_t e = first_edge[u]; e != NO_EDGE; e = edges[e].next) {
+      if (edges[e].cap == 0)
+        continue;
+      std::uint32_t v = edges[e].to;
+      std::int64_t next_dist = top.first + reducedCost(e);
+      if (next_dist < dist[v]) {
+        dist[v] = next_dist;
+        heap.push_back(Entry(next_dist, v));
+        std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+      }
+    }
+  }
+  if (nearest_deficit == UNREACHED)
+    throw std::logic_error("Assignment flow has excess that cannot reach a deficit");
+
+  // Reduced costs stay non-negative, and become zero along shortest paths
+  for (std::uint32_t n = 0; n < potential.size(); n++)
+    potential[n] += std::min(dist[n], nearest_deficit);
+}
+
+void AssignmentFlow::blockingFlow() {
+  const std::size_t number_nodes = first_edge.size();
+  level.assign(number_nodes, -1);
+  frontier.clear();
+  for (std::uint32_t n = 0; n < number_nodes; n++) {
+    if (excess[n] > 0) {
+      level[n] = 0;
+      frontier.push_back(n);
+    }
+  }
+  for (std::size_t i = 0; i < frontier.size(); i++) {
+    std::uint32_t u = frontier[i];
+    if (excess[u] < 0)
+      continue; // Flow stops at deficits
+    for (std::uint32_t e = first_edge[u]; e != NO_EDGE; e = edges[e].next) {
+      std::uint32_t v = edges[e].to;
+      if (edges[e].cap > 0 && level[v] < 0 && reducedCost(e) == 0) {
+        level[v] = level[u] + 1;
+        frontier.push_back(v);
+      }
+    }
+  }
+
+  current_edge = first_edge;
+  for (std::uint32_t source = 0; source < number_nodes; source++) {
+    if (level[source] != 0)
+      continue;
+    std::uint32_t u = source;
+    path.clear();
+    while (excess[source] > 0) {
+      if (u != source && excess[u] < 0) {
+        std::int64_t amount = std::min(excess[source], -excess[u]);
+        for (std::uint32_t e : path)
+          amount = std::min(amount, edges[e].cap);
+        for (std::uint32_t e : path) {
+          edges[e].cap -= amount;
+          edges[e ^ 1].cap += amount;
+        }
+        excess[source] -= amount;
+        excess[u] += amount;
+        path.clear();
+        u = source;
+        continue;
+      }
+      std::uint32_t& e = current_edge[u];
+      while (e != NO_EDGE && !(edges[e].cap > 0 && level[edges[e].to] == level[u] + 1 && reducedCost(e) == 0))
+        e = edges[e].next;
+      if (e != NO_EDGE) {
+        path.push_back(e);
+        u = edges[e].to;
+        continue;
+      }
+      // Dead end, so retreat and skip the edge that led here
+      level[u] = -1;
+      if (path.empty())
+        break;
+      u = edges[path.back() ^ 1].to;
+      path.pop_back();
+      current_edge[u] = edges[current_edge[u]].next;
+    }
+  }
+}
+
+std::int64_t AssignmentFlow::applyAssignment(PlantPool& plants, PopulationMatrix& pops) {
+  std::int64_t change = 0;
+  const std::uint32_t first_cell = 1 + (std::uint32_t) plant_of_node.size();
+  // Take people off plants first, so they are unserviced before being reassigned
+  for (int pass = 0; pass < 2; pass++) {
+    for (std::uint32_t n = first_cell; n < first_edge.size(); n++) {
+      const Coord& c = cell_of_node[n - first_cell];
+      for (std::uint32_t e = first_edge[n]; e != NO_EDGE; e = edges[e].next) {
+        std::uint32_t to = edges[e].to;
+        if (to == SINK || to >= first_cell)
+          continue;
+        PlantHandle plant = plant_of_node[to - 1];
+        int flow = (int) edges[e ^ 1].cap;
+        int served = pops.numberServicedAtCoordByPlant(c, plant);
+        if (pass == 0 && flow < served) {
+          pops.unassignServicedPop(plant, c, served - flow);
+          plants.changeServicedPop(plant, c, flow - served);
+          change += flow - served;
+        } else if (pass == 1 && flow > served) {
+          pops.assignUnservicedPop(plant, c, flow - served);
+          plants.changeServicedPop(plant, c, flow - served);
+          change += flow - served;
+        }
+      }
+    }
+  }
+  return change;
+}
+
+void AssignmentFlow::keepPotentials() {
+  const std::uint32_t first_cell = 1 + (std::uint32_t) plant_of_node.size();
+  std::int64_t sink = potential[SINK];
+  for (std::uint32_t n = 1; n < first_cell; n++)
+    plant_potential[plant_of_node[n - 1].id] = potential[n] - sink;
+  for (std::uint32_t n = first_cell; n < first_edge.size(); n++) {
+    const Coord& c = cell_of_node[n - first_cell];
+    cell_potential.at(c.x, c.y) = potential[n] - sink;
+  }
+}
+
+std::int64_t AssignmentFlow::solve(PlantPool& plants, PopulationMatrix& pops) {
+  buildNetwork(plants, pops);
+  guessPotentials();
+  saturateNegativeEdges();
+  number_phases = 0;
+  while (std::any_of(excess.begin(), excess.end(), [](std::int64_t x) { return x > 0; })) {
+    shortestPaths();
+    blockingFlow();
+    number_phases++;
+  }
+  std::int64_t change = applyAssignment(plants, pops);
+  keepPotentials();
+  return change;
+}
@@ -1,30 +1,164 @@
 #include "../include/BitMatrix.h"
+#include "../include/MatrixKernels.h"
+
+#include <algorithm>
+#include <stdexcept>
 
 using namespace MARS;
 
+static const BitMatrix::Word ALL_BITS = ~(BitMatrix::Word) 0;
+
+static int countTrailingZeros(BitMatrix::Word word) {
+  #ifdef __GNUC__
+  return __builtin_ctzll(word);
+  #else
+  int n = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    n++;
+  }
+  return n;
+  #endif
+}
+
+static void applyMask(BitMatrix::Word& word, BitMatrix::Word mask, bool val) {
+  word = val ? word | mask : word & ~mask;
+}
+
+/* Set or clear columns [begin, end) of a packed row */
+static void setColumns(BitMatrix::Word* row, int begin, int end, bool val) {
+  if (begin >= end)
+    return;
+  int first = begin / BitMatrix::word_bits;
+  int last = (end - 1) / BitMatrix::word_bits;
+  BitMatrix::Word first_mask = ALL_BITS << (begin % BitMatrix::word_bits);
+  BitMatrix::Word last_mask = ALL_BITS >> (BitMatrix::word_bits - 1 - (end - 1) % BitMatrix::word_bits);
+  if (first == last) {
+    applyMask(row[first], first_mask & last_mask, val);
+    return;
+  }
+  applyMask(row[first], first_mask, val);
+  std::fill(row + first + 1, row + last, val ? ALL_BITS : 0);
+  applyMask(row[last], last_mask, val);
+}
+
 BitMatrix::BitMatrix(int rows, int cols): 
   num_rows(rows),
   num_cols(cols),
-  matrix(rows, cols / (8 * sizeof(int)) + 1) 
+  matrix(rows, (cols + word_bits - 1) / word_bits, MATRIX_PADDED) 
 {
 }
 
 bool BitMatrix::get(int r, int c) const {
-  int cd = c / (8 * sizeof(int));
-  int cr = c % (8 * sizeof(int));
+  int cd = c / word_bits;
+  int cr = c % word_bits;
 
-  return (matrix.at(r, cd) & (1 << cr)) != 0;
+  return (matrix.at(r, cd) & ((Word) 1 << cr)) != 0;
 }
 
 void BitMatrix::set(int r, int c, bool val) {
-  int cd = c / (8 * sizeof(int));
-  int cr = c % (8 * sizeof(int));
+  int cd = c / word_bits;
+  int cr = c % word_bits;
 
   if (val) {
-    matrix.at(r, cd) |= (1 << cr);
+    matrix.at(r, cd) |= ((Word) 1 << cr);
   } else {
-    matrix.at(r, cd) &= ~(1 << cr);
+    matrix.at(r, cd) &= ~((Word) 1 << cr);
+  }
+}
+
+void BitMatrix::fillRect(int r, int c, int rows, int cols) {
+  for (int i = r; i < r + rows; i++) {
+    setColumns(matrix.rowPtr(i), c, c + cols, true);
+  }
+}
+
+void BitMatrix::clearRect(int r, int c, int rows, int cols) {
+  for (int i = r; i < r + rows; i++) {
+    setColumns(matrix.rowPtr(i), c, c + cols, false);
+  }
+}
+
+void BitMatrix::clear() {
+  matrix.resetToDefault();
+}
+
+void BitMatrix::checkSameShape(const BitMatrix& other) const {
+  if (num_rows != other.num_rows || num_cols != other.num_cols)
+    throw std::invalid_argument("BitMatrix dimensions differ");
+}
+
+BitMatrix& BitMatrix::operator&=(const BitMatrix& other) {
+  checkSameShape(other);
+  MatrixKernels::andInto(matrix, other.matrix.view());
+  return *this;
+}
+
+BitMatrix& BitMatrix::operator|=(const BitMatrix& other) {
+  checkSameShape(other);
+  MatrixKernels::orInto(matrix, other.matrix.view());
+  return *this;
+}
+
+BitMatrix& BitMatrix::operator^=(const BitMatrix& other) {
+  checkSameShape(other);
+  MatrixKernels::xorInto(matrix, other.matrix.view());
+  return *this;
+}
+
+BitMatrix& BitMatrix::andNot(const BitMatrix& other) {
+  checkSameShape(other);
+  MatrixKernels::andNotInto(matrix, other.matrix.view());
+  return *this;
+}
+
+std::int64_t BitMatrix::countRow(int r) const {
+  return MatrixKernels::popcount(matrix.view().row(r));
+}
+
+std::int64_t BitMatrix::count() const {
+  return MatrixKernels::popcount(matrix.view());
+}
+
+int BitMatrix::findNextInRow(int r, int c) const {
+  return findNextInRow(r, c, num_cols);
+}
+
+int BitMatrix::findNextInRow(int r, int c, int end) const {
+  end = end < num_cols ? end : num_cols;
+  if (c >= end)
+    return -1;
+  const Word* row = matrix.rowPtr(r);
+  int w = c / word_bits;
+  Word word = row[w] & (ALL_BITS << (c % word_bits));
+  int words = (end + word_bits - 1) / word_bits;
+  while (word == 0) {
+    if (++w == words)
+      return -1;
+    word = row[w];
   }
+  int found = w * word_bits + countTrailingZeros(word);
+  return found < end ? found : -1;
+}
+
+bool BitMatrix::findNext(int& r, int& c) const {
+  for (int i = r, j = c; i < num_rows; i++, j = 0) {
+    int found = findNextInRow(i, j);
+    if (found >= 0) {
+      r = i;
+      c = found;
+      return true;
+    }
+  }
+  return false;
+}
+
+const BitMatrix::Word* BitMatrix::rowWords(int r) const {
+  return matrix.rowPtr(r);
+}
+
+int BitMatrix::wordsPerRow() const {
+  return matrix.numberCols();
 }
 
 int BitMatrix::numRows() const {
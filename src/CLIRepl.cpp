@@ -7,9 +7,11 @@
 #include "CLIRepl.h"
 #include "INIReader.h"
 #include "Matrix.h"
+#include "MatrixKernels.h"
 #include "Terrain.h"
 #include "Coord.h"
 #include "Clustering.h"
+#include "CoverageCache.h"
 
 
 using namespace MARS;
@@ -41,6 +43,8 @@ void CLIRepl::initializeGame(std::string inifile) {
   double operating_cost = ini.GetReal("Default", "PlantOperatingCost", 25.0);            
   double profit_margin = ini.GetReal("Default", "PlantProfitMargin", 5.0);
   double unserviced_penalty = ini.GetReal("Default", "UnservicedPenalty", 1.0);
+  std::string storage_path = ini.Get("Default", "StoragePath", "");
+  bool sparse_population = ini.GetBoolean("Default", "SparsePopulation", false);
   size_x = dx;
   size_y = dy;
   game = new Game(
@@ -52,7 +56,9 @@ void CLIRepl::initializeGame(std::string inifile) {
     initial_cost, 
     operating_cost, 
     profit_margin,
-    unserviced_penalty);
+    unserviced_penalty,
+    storage_path,
+    sparse_population);
   game_display = new GameDisplay(game, 15, 50);
 }
 
@@ -90,6 +96,7 @@ void CLIRepl::printUsage() {
   std::cout << "step x - steps the game `x' times without making a plant" << std::endl;
   std::cout << "step plant r c - steps the game while making a plant at location (r, c)" << std::endl;
   std::cout << "cluster k - runs K-means clustering with k clusters to create new plant" << std::endl;
+  std::cout << "stats - print game statistics" << std::endl;
   std::cout << "help - print this list of commands" << std::endl;
   std::cout << "kmeans x s k /path/to/file.csv - steps x times, clusters (with k-means) every s steps, logs output as CSV" << std::endl;
   std::cout << "kmedians x s k /path/to/file.csv - steps x times, clusters (with k-medians) every s steps, logs output as CSV" << std::endl;
@@ -100,21 +107,30 @@ void CLIRepl::printUsage() {
 }
 
 void CLIRepl::printStats() {
-
+  std::cout << "Time: " << game->currentTime() << std::endl;
+  std::cout << "Plants in service: " << game->numberPlantsInService() << std::endl;
+  std::cout << "Serviced population: " << game->numberServicedPop() << std::endl;
+  std::cout << "Unserviced population: " << game->numberUnservicedPop() << std::endl;
+  std::cout << "Funds: " << game->currentFunds() << std::endl;
+
+  const CoverageCache& cache = CoverageCache::shared();
+  std::cout << "Coverage cache: " << cache.hits() << " hits, " << cache.misses() << " misses, "
+            << cache.evictions() << " evictions, " << cache.size() << " areas in "
+            << cache.memoryUsage() / 1024 << " KB" << std::endl;
 }
 
 void CLIRepl::stepWithKMeans(int k) {
-  std::pair<bool, Coord> res = Clustering::placePlantKMeans(game->popMatrixCopy(), k);
+  std::pair<bool, Coord> res = Clustering::placePlantKMeans(game->popMatrixView(), k);
   game->step(res.first, res.second);
 }
 
 void CLIRepl::stepWithKMedians(int k) {
-  std::pair<bool, Coord> res = Clustering::placePlantKMedians(game->popMatrixCopy(), k);
+  std::pair<bool, Coord> res = Clustering::placePlantKMedians(game->popMatrixView(), k);
   game->step(res.first, res.second);
 }
 
 void CLIRepl::stepWithRandom() {
-  std::pair<bool, Coord> res = Clustering::placePlantRandom(game->popMatrixCopy());
+  std::pair<bool, Coord> res = Clustering::placePlantRandom(game->popMatrixView());
   std::cout << res.first << " " << res.second.x << " " << res.second.y << std::endl;
   game->step(res.first, res.second);
 }
@@ -230,23 +246,14 @@ void CLIRepl::placePlantLoop(std::string method, int steps, std::string path) {
       // determine k value using heuristic
       // the greater the variance in unserviced population, the more clusters we need
 
-      float meanUnserviced = 0;
-      Matrix<int> unservicedMatrix = this->game->popMatrixCopy().unservicedPopMatrix();
+      const PopulationMatrix& popMatrix = this->game->popMatrixView();
+      double cells = (double) popMatrix.sizeX() * popMatrix.sizeY();
 
-      for(int i = 0; i < unservicedMatrix.numberRows(); i++) {
-        for(int j = 0; j < unservicedMatrix.numberCols(); j++) {
-          meanUnserviced += unservicedMatrix.at(i, j);
-        }
-      }
-      meanUnserviced /= (unservicedMatrix.numberRows() * unservicedMatrix.numberCols());
+      // sum((x - mean)^2) == sum(x^2) - cells * mean^2, so both come from one pass each
+      double meanUnserviced = popMatrix.unservicedTotal() / cells;
+      double sumSquaresUnserviced = (double) popMatrix.unservicedSumOfSquares();
 
-      float varianceUnserviced = 0;
-      for(int i = 0; i < unservicedMatrix.numberRows(); i++) {
-        for(int j = 0; j < unservicedMatrix.numberCols(); j++) {
-          varianceUnserviced += ((unservicedMatrix.at(i, j)) - meanUnserviced) * ((unservicedMatrix.at(i, j)) - meanUnserviced);
-        }
-      }
-      varianceUnserviced /= ((unservicedMatrix.numberRows()*unservicedMatrix.numberCols())-1);
+      float varianceUnserviced = (float) ((sumSquaresUnserviced - cells * meanUnserviced * meanUnserviced) / (cells - 1));
 
       if(method == "kmeans") {
         this->stepWithKMeans((int)varianceUnserviced + 1);
@@ -301,7 +308,7 @@ void CLIRepl::doCommand(std::vector<std::string> tokens) {
       std::cout << "step: Did not provide correct number of arguments" << std::endl;
     }
   } else if (command == "stats") {
-    this->printUsage();
+    this->printStats();
   } else if (tokens.size() == 2 && tokens[0] == "cluster") {
     int k = std::stoi(tokens[1]);
     this->stepWithKMeans(k);
@@ -13,7 +13,7 @@ using namespace MARS;
 #define MIN_CENTROID_DIFFERENCE 0.5
 
 std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>> 
-  Clustering::runKMeans(PopulationMatrix popMatrix, int k) {
+  Clustering::runKMeans(const PopulationMatrix& popMatrix, int k) {
 
   std::vector<std::vector<Coord>> clusters = std::vector<std::vector<Coord>>();
   std::vector<Coord> centroids = std::vector<Coord>();
@@ -114,7 +114,7 @@ std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>>
 }
 
 std::pair <std::vector<Coord>, std::vector<std::vector<Coord>>> 
-  Clustering::runKMedians(PopulationMatrix popMatrix, int k) {
+  Clustering::runKMedians(const PopulationMatrix& popMatrix, int k) {
 
     /* TODO: DRY */
 
@@ -254,7 +254,7 @@ std::pair <bool, Coord> Clustering::processClusteringResults(
   return std::pair<bool,Coord>(unservicedClusterExists, placement);
 }
 
-std::pair<bool, Coord> Clustering::placePlantKMeans(PopulationMatrix popMatrix, int k) {
+std::pair<bool, Coord> Clustering::placePlantKMeans(const PopulationMatrix& popMatrix, int k) {
   // Take the largest unserviced cluster and place a plant at its center
 
   std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>> clusterResult = Clustering::runKMeans(popMatrix, k);
@@ -265,7 +265,7 @@ std::pair<bool, Coord> Clustering::placePlantKMeans(PopulationMatrix popMatrix,
   return Clustering::processClusteringResults(centroids, clusters);
 }
 
-std::pair<bool, Coord> Clustering::placePlantKMedians(PopulationMatrix popMatrix, int k) {
+std::pair<bool, Coord> Clustering::placePlantKMedians(const PopulationMatrix& popMatrix, int k) {
   // Take the largest unserviced cluster and place a plant at its center
 
   std::pair<std::vector<Coord>, std::vector<std::vector<Coord>>> clusterResult = Clustering::runKMedians(popMatrix, k);
@@ -276,7 +276,7 @@ std::pair<bool, Coord> Clustering::placePlantKMedians(PopulationMatrix popMatrix
   return Clustering::processClusteringResults(centroids, clusters);
 }
 
-std::pair<bool, Coord> Clustering::placePlantRandom(PopulationMatrix popMatrix) {
+std::pair<bool, Coord> Clustering::placePlantRandom(const PopulationMatrix& popMatrix) {
   /* Random baseline method */
   int coinFlip = rand() % 2;
   if(coinFlip == 0) {
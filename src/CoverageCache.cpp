@@ -0,0 +1,117 @@
+#include "../include/CoverageCache.h"
+
+#include <cstring>
+
+#include "../include/ServiceableAreaSearch.h"
+
+using namespace MARS;
+
+/*
+ * Search scratch space shared by every search on this thread, so a search
+ * only touches the cells it reaches rather than a whole-map buffer.
+ */
+static ServiceableAreaSearch& scratchSearch() {
+  static thread_local ServiceableAreaSearch search;
+  return search;
+}
+
+std::size_t CoverageCache::KeyHash::operator()(const Key& key) const {
+  std::uint64_t dist_bits = 0;
+  double serve_dist = key.serve_dist + 0.0; // Folds -0.0 into 0.0, which compare equal
+  std::memcpy(&dist_bits, &serve_dist, sizeof(dist_bits));
+  std::uint64_t hash = mixHash(packCoord(key.location) ^ key.generation_id * 0x9E3779B97F4A7C15ull);
+  return (std::size_t) mixHash(hash ^ dist_bits);
+}
+
+CoverageCache::CoverageCache(std::size_t capacity_bytes):
+  capacity_bytes(capacity_bytes),
+  used_bytes(0),
+  number_hits(0),
+  number_misses(0),
+  number_evictions(0)
+{
+}
+
+CoverageCache& CoverageCache::shared() {
+  static CoverageCache cache;
+  return cache;
+}
+
+std::size_t CoverageCache::stencilBytes(const CoverageStencil& stencil) {
+  return sizeof(CoverageStencil) + stencil.memoryUsage();
+}
+
+void CoverageCache::evict() {
+  while (used_bytes > capacity_bytes && entries.size() > 1) {
+    used_bytes -= stencilBytes(*entries.back().second);
+    index.erase(entries.back().first);
+    entries.pop_back();
+    number_evictions++;
+  }
+}
+
+CoverageCache::StencilPtr CoverageCache::get(const Terrain& terrain, const Coord& location, double serve_dist) {
+  // Every distance that reaches nothing shares one key, which also keeps NaN out of the index
+  Key key = {terrain.generationId(), location, serve_dist >= 0 ? serve_dist : -1.0};
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = index.find(key);
+    if (found != index.end()) {
+      number_hits++;
+      entries.splice(entries.begin(), entries, found->second);
+      return found->second->second;
+    }
+    number_misses++;
+  }
+
+  std::shared_ptr<CoverageStencil> stencil = std::make_shared<CoverageStencil>(terrain.sizeY());
+  scratchSearch().run(terrain, location, serve_dist, *stencil);
+
+  std::lock_guard<std::mutex> guard(lock);
+  auto found = index.find(key);
+  if (found != index.end())
+    return found->second->second;
+  entries.push_front(std::make_pair(key, StencilPtr(stencil)));
+  index[key] = entries.begin();
+  used_bytes += stencilBytes(*stencil);
+  evict();
+  return stencil;
+}
+
+void CoverageCache::setCapacity(std::size_t capacity_bytes) {
+  std::lock_guard<std::mutex> guard(lock);
+  this->capacity_bytes = capacity_bytes;
+  evict();
+}
+
+void CoverageCache::clear() {
+  std::lock_guard<std::mutex> guard(lock);
+  entries.clear();
+  index.clear();
+  used_bytes = 0;
+}
+
+std::size_t CoverageCache::hits() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return number_hits;
+}
+
+std::size_t CoverageCache::misses() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return number_misses;
+}
+
+std::size_t CoverageCache::evictions() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return number_evictions;
+}
+
+std::size_t CoverageCache::size() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return entries.size();
+}
+
+std::size_t CoverageCache::memoryUsage() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return used_bytes;
+}
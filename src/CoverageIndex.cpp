@@ -0,0 +1,61 @@
+#include "../include/CoverageIndex.h"
+
+#include <algorithm>
+
+using namespace MARS;
+
+CoverageIndex::CoverageIndex(int rows, int cols, const PlantPool& plants):
+  plants(&plants),
+  list_of_cell(rows, cols, MATRIX_GRID),
+  epoch(0)
+{
+}
+
+void CoverageIndex::addPlant(PlantHandle plant) {
+  const CoverageStencil& area = plants->serviceableArea(plant);
+  for (std::size_t i = 0; i < area.size(); i++) {
+    Coord c = area.coordAt(i);
+    std::uint32_t& list = list_of_cell.at(c.x, c.y);
+    if (list == 0) {
+      lists.push_back(CellList());
+      list = (std::uint32_t) lists.size();
+    }
+    CellList& cell = lists[list - 1];
+    Candidate candidate = {(std::uint32_t) area.distanceAt(i), plant.id};
+    // After every plant at the same distance, as they were added first
+    std::vector<Candidate>::iterator position = std::upper_bound(
+      cell.candidates.begin(), cell.candidates.end(), candidate,
+      [](const Candidate& a, const Candidate& b) { return a.dist < b.dist; });
+    std::uint32_t inserted = (std::uint32_t) (position - cell.candidates.begin());
+    cell.candidates.insert(position, candidate);
+    if (inserted <= cell.first_open)
+      cell.first_open = inserted;
+  }
+}
+
+PlantHandle CoverageIndex::bestPlant(const Coord& c) const {
+  std::uint32_t list = list_of_cell.at(c.x, c.y);
+  if (list == 0)
+    return PlantHandle();
+  const CellList& cell = lists[list - 1];
+  if (cell.epoch != epoch) {
+    cell.first_open = 0;
+    cell.epoch = epoch;
+  }
+  while (cell.first_open < cell.candidates.size()) {
+    std::uint32_t plant = cell.candidates[cell.first_open].plant;
+    if (plants->remainingCapacityOf(plant) > 0)
+      return plants->handleAt(plant);
+    cell.first_open++;
+  }
+  return PlantHandle();
+}
+
+void CoverageIndex::capacityFreed() {
+  epoch++;
+}
+
+int CoverageIndex::numberCovering(const Coord& c) const {
+  std::uint32_t list = list_of_cell.at(c.x, c.y);
+  return list == 0 ? 0 : (int) lists[list - 1].candidates.size();
+}
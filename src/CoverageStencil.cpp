@@ -0,0 +1,120 @@
+#include "../include/CoverageStencil.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+using namespace MARS;
+
+CoverageShape::CoverageShape(const Coord& origin, int grid_cols, const std::vector<std::uint64_t>& entries):
+  first_row(0),
+  first_col(0),
+  width(1),
+  is_interned(false),
+  cells(entries.size()),
+  dists(entries.size())
+{
+  if (!entries.empty()) {
+    int min_row = (int) ((entries.front() >> 32) / grid_cols);
+    int min_col = grid_cols;
+    int max_col = 0;
+    for (std::uint64_t entry : entries) {
+      int col = (int) ((entry >> 32) % grid_cols);
+      min_col = std::min(min_col, col);
+      max_col = std::max(max_col, col);
+    }
+    first_row = min_row - origin.x;
+    first_col = min_col - origin.y;
+    width = max_col - min_col + 1;
+    // Row-major order in the grid is row-major order in the bounding box
+    for (std::size_t i = 0; i < entries.size(); i++) {
+      std::uint32_t cell = (std::uint32_t) (entries[i] >> 32);
+      cells[i] = (cell / grid_cols - min_row) * width + cell % grid_cols - min_col;
+      dists[i] = (std::uint32_t) entries[i];
+    }
+  }
+  buildRowIndex();
+}
+
+CoverageShape::CoverageShape(int radius, std::uint32_t step_cost):
+  first_row(-radius),
+  first_col(-radius),
+  width(2 * radius + 1),
+  is_interned(true)
+{
+  cells.reserve(2 * radius * (radius + 1));
+  dists.reserve(2 * radius * (radius + 1));
+  for (int dx = -radius; dx <= radius; dx++) {
+    int span = radius - std::abs(dx);
+    for (int dy = -span; dy <= span; dy++) {
+      if (dx == 0 && dy == 0)
+        continue;
+      cells.push_back((dx + radius) * width + dy + radius);
+      dists.push_back((std::abs(dx) + std::abs(dy)) * step_cost);
+    }
+  }
+  buildRowIndex();
+}
+
+void CoverageShape::buildRowIndex() {
+  row_begin.clear();
+  if (cells.empty())
+    return;
+  std::uint32_t rows = cells.back() / width + 1;
+  row_begin.resize(rows + 1);
+  std::size_t i = 0;
+  for (std::uint32_t row = 0; row < rows; row++) {
+    row_begin[row] = (std::uint32_t) i;
+    std::uint32_t row_end = (row + 1) * width;
+    while (i < cells.size() && cells[i] < row_end)
+      i++;
+  }
+  row_begin.back() = (std::uint32_t) cells.size();
+}
+
+std::shared_ptr<const CoverageShape> CoverageShape::diamond(int radius, std::uint32_t step_cost) {
+  static std::mutex lock;
+  static std::map<std::pair<int, std::uint32_t>, std::shared_ptr<const CoverageShape>> diamonds;
+
+  std::lock_guard<std::mutex> guard(lock);
+  std::shared_ptr<const CoverageShape>& shape = diamonds[std::make_pair(radius, step_cost)];
+  if (!shape)
+    shape.reset(new CoverageShape(radius, step_cost));
+  return shape;
+}
+
+int CoverageShape::find(int dx, int dy) const {
+  int row = dx - first_row;
+  int col = dy - first_col;
+  if (row < 0 || row + 1 >= (int) row_begin.size() || col < 0 || col >= width)
+    return -1;
+  std::uint32_t cell = (std::uint32_t) row * width + col;
+  const std::uint32_t* row_first = cells.data() + row_begin[row];
+  const std::uint32_t* row_last = cells.data() + row_begin[row + 1];
+  const std::uint32_t* found = std::lower_bound(row_first, row_last, cell);
+  if (found == row_last || *found != cell)
+    return -1;
+  return (int) (found - cells.data());
+}
+
+std::size_t CoverageShape::memoryUsage() const {
+  return sizeof(CoverageShape) + (cells.capacity() + dists.capacity() + row_begin.capacity()) * sizeof(std::uint32_t);
+}
+
+CoverageStencil::CoverageStencil(int grid_cols):
+  origin(0, 0),
+  grid_cols(grid_cols)
+{
+}
+
+CoverageStencil::CoverageStencil(std::shared_ptr<const CoverageShape> shape, const Coord& origin, int grid_cols):
+  area(std::move(shape)),
+  origin(origin),
+  grid_cols(grid_cols)
+{
+}
+
+std::size_t CoverageStencil::memoryUsage() const {
+  return area && !area->interned() ? area->memoryUsage() : 0;
+}
@@ -1,14 +1,19 @@
+#include <algorithm>
 #include <queue>
 #include <limits>
+#include <stdexcept>
 #include <iostream>
 
 #include "Game.h"
 #include "Matrix.h"
+#include "MatrixKernels.h"
 #include "PopulationGen.h"
 #include "Terrain.h"
 
 using namespace MARS;
 
+static_assert(POP_MAX <= std::numeric_limits<PopCount>::max(), "PopCount is too narrow to hold POP_MAX people");
+
 Game::Game(
   int dx,
   int dy,
@@ -18,7 +23,9 @@ Game::Game(
   double initial_cost,
   double operating_cost,
   double profit_margin,
-  double unserviced_penalty
+  double unserviced_penalty,
+  const std::string& storage_path,
+  bool sparse_population
 ) :
   size_x(dx),
   size_y(dy),
@@ -33,9 +40,50 @@ Game::Game(
   plant_operating_cost(operating_cost),
   plant_profit_margin(profit_margin),
   plants_in_service(),
+  coverage_index(dx, dy, plants_in_service),
   unserviced_pop_penalty(unserviced_penalty),
-  pop_matrix(dx, dy),
-  terrain(dx, dy),
+  pop_matrix(dx, dy, storage_path.empty() || sparse_population ? "" : storage_path + "/population", sparse_population),
+  plant_grid(dx, dy),
+  is_active_cell(dx, dy),
+  assignment_engine(GREEDY_ASSIGNMENT),
+  terrain(storage_path.empty() ? Terrain(dx, dy) : Terrain(dx, dy, storage_path + "/terrain")),
+  pop_gen(),
+  rlState(*this)
+{
+
+}
+
+Game::Game(
+  const Terrain& terrain,
+  int number_turns,
+  int default_capacity,
+  double serveable_distance,
+  double initial_cost,
+  double operating_cost,
+  double profit_margin,
+  double unserviced_penalty,
+  bool sparse_population
+) :
+  size_x(terrain.sizeX()),
+  size_y(terrain.sizeY()),
+  time(0),
+  number_turns(number_turns),
+  number_pop_serviced(0),
+  number_plants_in_service(0),
+  number_new_plants(0),
+  plant_default_capacity(default_capacity),
+  plant_servable_distance(serveable_distance),
+  plant_initial_cost(initial_cost),
+  plant_operating_cost(operating_cost),
+  plant_profit_margin(profit_margin),
+  plants_in_service(),
+  coverage_index(terrain.sizeX(), terrain.sizeY(), plants_in_service),
+  unserviced_pop_penalty(unserviced_penalty),
+  pop_matrix(terrain.sizeX(), terrain.sizeY(), "", sparse_population),
+  plant_grid(terrain.sizeX(), terrain.sizeY()),
+  is_active_cell(terrain.sizeX(), terrain.sizeY()),
+  assignment_engine(GREEDY_ASSIGNMENT),
+  terrain(terrain),
   pop_gen(),
   rlState(*this)
 {
@@ -43,26 +91,30 @@ Game::Game(
 }
 
 Game::~Game() {
-  for (Plant* p: plants_in_service) {
-    delete p;
-  }
 }
 
 void Game::step(bool add_plant, const Coord& plant_coord) {
 
-  Matrix<int> new_population = pop_gen.generate(this->pop_matrix.totalPopMatrix(), this->terrain, this->time);
-  pop_matrix.addUnservicedPop(new_population);
-  processUnservicedPopulation();
-  
-  //if new plant was added
-  if (add_plant) {
-    if (!isPlantPresent(plant_coord)) {
-      if (terrain.weightAtXY(plant_coord.x, plant_coord.y) != WATER_WEIGHT &&
-        terrain.weightAtXY(plant_coord.x, plant_coord.y) != MOUNTAIN_WEIGHT) {
-        Plant* new_plant = createPlant(plant_coord);
-        std::queue<Plant*> touched_plants = considerNewPlant(new_plant, false);
-        processTouchedPlants(touched_plants);
-      }
+  if (pop_gen.advance(this->time)) {
+    pop_matrix.addUnservicedPop(pop_gen.growth(this->pop_matrix.totalPop(), this->terrain));
+    plants_in_service.forEach([this](PlantHandle plant) {
+      if (plants_in_service.remainingCapacity(plant) > 0)
+        activatePlant(plant);
+    });
+  }
+
+  if (assignment_engine == MIN_COST_FLOW_ASSIGNMENT) {
+    if (add_plant && canPlacePlant(plant_coord))
+      createPlant(plant_coord);
+    solveAssignmentFlow();
+  } else {
+    processUnservicedPopulation();
+
+    //if new plant was added
+    if (add_plant && canPlacePlant(plant_coord)) {
+      PlantHandle new_plant = createPlant(plant_coord);
+      std::queue<PlantHandle> touched_plants = considerNewPlant(new_plant, false);
+      processTouchedPlants(touched_plants);
     }
   }
 
@@ -75,6 +127,12 @@ void Game::step(bool add_plant, const Coord& plant_coord) {
   this->number_new_plants = 0;
   this->time++;
 
+  #ifdef FLAG_POPULATION_TOTALS_CHECKING
+  // The population totals are kept incrementally, so recount them to catch drift
+  if (!pop_matrix.totalsConsistent())
+    throw std::logic_error("Population totals drifted from the population layers");
+  #endif
+
   rlState.update(*this);
 }
 
@@ -88,9 +146,9 @@ double Game::calculateObjective() const {
 
 std::vector<Coord> Game::plantLocations() const {
   std::vector<Coord> result;
-  for (Plant *p : plants_in_service) {
-    result.push_back(p->location);
-  }
+  plants_in_service.forEach([this, &result](PlantHandle p) {
+    result.push_back(plants_in_service.location(p));
+  });
   return result;
 }
 
@@ -99,7 +157,7 @@ int Game::numberPlantsInService() const {
 }
 
 int Game::numberTotalPopAt(int i, int j) const {
-  return this->pop_matrix.totalPopMatrix().at(i,j);
+  return this->pop_matrix.numberTotalAtCoord(Coord(i, j));
 }
 
 int Game::numberServicedPop() const {
@@ -107,14 +165,7 @@ int Game::numberServicedPop() const {
 }
 
 int Game::numberUnservicedPop() const {
-  int total = 0;
-  Matrix<int> unserviced_pop_matrix = this->pop_matrix.unservicedPopMatrix();
-  for (int i = 0; i < unserviced_pop_matrix.numberRows(); i++) {
-    for (int j = 0; j < unserviced_pop_matrix.numberCols(); j++) {
-      total += unserviced_pop_matrix.at(i, j);
-    }
-  }
-  return total;
+  return (int) this->pop_matrix.unservicedTotal();
 }
 
 double Game::currentFunds() const {
@@ -141,6 +192,14 @@ PopulationMatrix Game::popMatrixCopy() const {
   return this->pop_matrix;
 };
 
+const PopulationMatrix& Game::popMatrixView() const {
+  return this->pop_matrix;
+}
+
+const Terrain& Game::terrainView() const {
+  return this->terrain;
+}
+
 
 std::pair<int, int> Game::sizeXY() const {
   return std::pair<int,int>(size_x, size_y);
@@ -154,25 +213,13 @@ int Game::sizeY() const {
   return size_y;
 }
 
-std::pair<Plant*, bool> Game::findBestPlant(const Coord& person_loc) const {
+std::pair<PlantHandle, bool> Game::findBestPlant(const Coord& person_loc) const {
   if (numberPlantsInService() == 0) {
-    return std::pair<Plant*, bool> (NULL, false);
+    return std::pair<PlantHandle, bool> (PlantHandle(), false);
   } else {
-    std::pair<Plant*, double> best_plant(this->plants_in_service.front(), std::numeric_limits<double>::max());
-    bool found_plant = false;
-    for (Plant* plant : this->plants_in_service) {
-      if (plant->isServiceableCoord(person_loc)) {
-        if (best_plant.second > plant->distanceToCoord(person_loc)) {
-          if (plant->remainingCapacity() > 0) {
-            //this plant has room to take new person
-            best_plant.second = plant->distanceToCoord(person_loc);
-            best_plant.first = plant;
-            found_plant = true;
-          }
-        }
-      }
-    }
-    return std::pair<Plant*, bool>(best_plant.first, found_plant);
+    //nearest plant with room to take new person, earliest built on ties
+    PlantHandle best_plant = this->coverage_index.bestPlant(person_loc);
+    return std::pair<PlantHandle, bool>(best_plant, !best_plant.isNull());
   }
 }
 
@@ -180,97 +227,158 @@ void Game::processUnservicedElement(int i, int j) {
   int number_to_service = pop_matrix.numberUnservicedAtCoord(Coord(i, j));
   if (number_to_service > 0) {
     int number_to_service = pop_matrix.numberUnservicedAtCoord(Coord(i, j));
-    std::pair<Plant*, bool> result = findBestPlant(Coord(i,j));
+    std::pair<PlantHandle, bool> result = findBestPlant(Coord(i,j));
     while (number_to_service > 0 and (result.second)) {
-      Plant* new_plant = result.first;
-      int add_to_service = std::min(new_plant->remainingCapacity(), number_to_service);
+      PlantHandle new_plant = result.first;
+      int add_to_service = std::min(plants_in_service.remainingCapacity(new_plant), number_to_service);
       this->number_pop_serviced += add_to_service;
       this->pop_matrix.assignUnservicedPop(new_plant, Coord(i,j), add_to_service);
-      new_plant->changeServicedPop(Coord(i,j), add_to_service);
+      plants_in_service.changeServicedPop(new_plant, Coord(i,j), add_to_service);
       number_to_service -= add_to_service;
       result = findBestPlant(Coord(i,j));
     }
   }
 }
 
+void Game::setAssignmentEngine(AssignmentEngine engine) {
+  this->assignment_engine = engine;
+}
+
+AssignmentEngine Game::assignmentEngine() const {
+  return this->assignment_engine;
+}
+
+void Game::solveAssignmentFlow() {
+  if (!assignment_flow)
+    assignment_flow.reset(new AssignmentFlow(size_x, size_y));
+  this->number_pop_serviced += (int) assignment_flow->solve(this->plants_in_service, this->pop_matrix);
+  // Plants may have lost people, and greedy steps may follow
+  this->coverage_index.capacityFreed();
+  plants_in_service.forEach([this](PlantHandle plant) {
+    if (plants_in_service.remainingCapacity(plant) > 0)
+      activatePlant(plant);
+  });
+}
+
+void Game::activatePlant(PlantHandle plant) {
+  if (plant.id >= is_activated_plant.size())
+    is_activated_plant.resize(plant.id + 1, 0);
+  if (is_activated_plant[plant.id])
+    return;
+  is_activated_plant[plant.id] = 1;
+  activated_plants.push_back(plant);
+}
+
 void Game::processUnservicedPopulation() {
-  for (int i = 0; i < this->pop_matrix.sizeX(); i++) {
-    for (int j = 0; j < this->pop_matrix.sizeY(); j++) {
-      this->processUnservicedElement(i,j);
+  for (PlantHandle plant : activated_plants) {
+    is_activated_plant[plant.id] = 0;
+    if (plants_in_service.remainingCapacity(plant) == 0)
+      continue;
+    const CoverageStencil& area = plants_in_service.serviceableArea(plant);
+    for (std::size_t i = 0; i < area.size(); i++) {
+      Coord c = area.coordAt(i);
+      std::uint8_t& active = is_active_cell.at(c.x, c.y);
+      if (!active) {
+        active = 1;
+        active_cells.push_back((std::uint32_t) c.x * size_y + c.y);
+      }
     }
   }
+  activated_plants.clear();
+
+  // Row-major order, as a scan of the whole grid would visit them
+  std::sort(active_cells.begin(), active_cells.end());
+  for (std::uint32_t cell : active_cells) {
+    int i = cell / size_y;
+    int j = cell % size_y;
+    is_active_cell.at(i, j) = 0;
+    processUnservicedElement(i, j);
+  }
+  active_cells.clear();
 }
 
-std::queue<Plant*> Game::processServicedPop(
-  Plant* plant,
+void Game::processServicedPop(
+  PlantHandle plant,
   const Coord& coord,
-  std::unordered_map<Plant*, int> serviced_map,
-  std::queue<Plant*>& queue)
+  const std::vector<PlantServing>& farther,
+  std::queue<PlantHandle>& queue)
 {
-  for (std::pair<Plant*, int> mapping : serviced_map) {
-    if (plant->remainingCapacity() > 0) {
-    Plant* old_plant = mapping.first;
-      if (plant->distanceToCoord(coord) < old_plant->distanceToCoord(coord)) {
-        int add_to_service = std::min(plant->remainingCapacity(), mapping.second);
-        this->pop_matrix.moveServicedPopBetweenPlants(old_plant, plant, coord, add_to_service);
-        plant->changeServicedPop(coord, add_to_service);
-        old_plant->changeServicedPop(coord, -add_to_service);
-        queue.push(old_plant);
-      }
+  //every plant in farther is farther from coord than plant
+  for (const PlantServing& serving : farther) {
+    if (plants_in_service.remainingCapacity(plant) > 0) {
+      PlantHandle old_plant = serving.plant;
+      int add_to_service = std::min(plants_in_service.remainingCapacity(plant), serving.count);
+      this->pop_matrix.moveServicedPopBetweenPlants(old_plant, plant, coord, add_to_service);
+      plants_in_service.changeServicedPop(plant, coord, add_to_service);
+      plants_in_service.changeServicedPop(old_plant, coord, -add_to_service);
+      this->coverage_index.capacityFreed();
+      activatePlant(old_plant);
+      queue.push(old_plant);
     }
   }
-  return queue;
 }
 
-Plant* Game::createPlant(const Coord& plant_loc) {
+PlantHandle Game::createPlant(const Coord& plant_loc) {
+  if (!canPlacePlant(plant_loc))
+    throw std::invalid_argument("Cannot place a plant there");
   this->number_new_plants++;
-  Plant* new_plant = new Plant(
+  PlantHandle new_plant = this->plants_in_service.create(
+    plant_loc,
     plant_default_capacity,
     plant_servable_distance,
-    plant_loc.x,
-    plant_loc.y,
     this->terrain
   );
-  this->plants_in_service.push_back(new_plant);
+  this->coverage_index.addPlant(new_plant);
+  this->plant_grid.at(plant_loc.x, plant_loc.y) = new_plant.id + 1;
+  activatePlant(new_plant);
   return new_plant;
 };
 
-std::queue<Plant*> Game::considerNewPlant(Plant* plant, bool touched) {
-  std::queue<Plant*> touched_plants;
-  std::unordered_map<Coord, std::pair<int, std::unordered_map<Plant*, int>>> pop_to_consider
-      = this->pop_matrix.potentialPopForPlant(plant);
-  for (std::pair<Coord, std::pair<int, std::unordered_map<Plant*,int>>> element : pop_to_consider) {
-    Coord coord = element.first;
-    std::unordered_map<Plant*, int> serviced_map = element.second.second;
-    processUnservicedElement(coord.x, coord.y);
-    processServicedPop(plant, coord, serviced_map, touched_plants);
-  }
+std::queue<PlantHandle> Game::considerNewPlant(PlantHandle plant, bool touched) {
+  std::queue<PlantHandle> touched_plants;
+  this->pop_matrix.forEachPotentialPop(this->plants_in_service, plant,
+    [&](const Coord& coord, double, int, const std::vector<PlantServing>& farther) {
+      processUnservicedElement(coord.x, coord.y);
+      processServicedPop(plant, coord, farther, touched_plants);
+    });
   if (!touched) {  //return queue of "touched" plants
     return touched_plants;
   } else { //processing a "touched" plant
-    std::queue<Plant*> empty;
+    std::queue<PlantHandle> empty;
     return empty;
   }
 };
 
-void Game::processTouchedPlants(std::queue<Plant*> touched_plants) {
+void Game::processTouchedPlants(std::queue<PlantHandle> touched_plants) {
   while (touched_plants.size() > 0) {//process each plant
-    Plant* plant = touched_plants.front();
-    std::queue<Plant*> empty = this->considerNewPlant(plant, true);
+    PlantHandle plant = touched_plants.front();
+    std::queue<PlantHandle> empty = this->considerNewPlant(plant, true);
     touched_plants.pop();
   }
 }
 
 bool Game::isPlantPresent(const Coord& coord) const {
-  for (int i =0; i < this->plants_in_service.size(); i++) {
-    Plant* plant = this->plants_in_service[i];
-    if (coord==(plant->location)) {
-      return true;
-    }
-  }
-  return false;
+  return !plantAt(coord).isNull();
 };
 
+PlantHandle Game::plantAt(const Coord& coord) const {
+  if (coord.x < 0 || coord.y < 0 || coord.x >= size_x || coord.y >= size_y)
+    return PlantHandle();
+  std::uint32_t id = this->plant_grid.at(coord.x, coord.y);
+  return id == 0 ? PlantHandle() : this->plants_in_service.handleAt(id - 1);
+}
+
+bool Game::canPlacePlant(const Coord& coord) const {
+  if (coord.x < 0 || coord.y < 0 || coord.x >= size_x || coord.y >= size_y)
+    return false;
+  double weight = terrain.weightAtXY(coord.x, coord.y);
+  return weight != WATER_WEIGHT && weight != MOUNTAIN_WEIGHT && this->plant_grid.at(coord.x, coord.y) == 0;
+}
+
+const PlantPool& Game::plants() const {
+  return this->plants_in_service;
+}
+
 double Game::fundsForCurrentStep() const {
   double objective;
   objective = this->funds - (this->plant_operating_cost)*(this->number_plants_in_service)
@@ -284,26 +392,27 @@ double Game::fundsForCurrentStep() const {
 
 
 Game::RLState::RLState(const Game& game) :
-  totalPops(game.sizeY(), game.sizeX()),
-  unservicedPops(game.sizeY(), game.sizeX()),
-  servicedPops(game.sizeY(), game.sizeX()),
-  terrain(game.sizeY(), game.sizeX()),
-  plantLocs(game.sizeY(), game.sizeX())
+  totalPops(game.sizeX(), game.sizeY(), MATRIX_GRID),
+  unservicedPops(game.sizeX(), game.sizeY(), MATRIX_GRID),
+  servicedPops(game.sizeX(), game.sizeY(), MATRIX_GRID),
+  terrain(game.sizeX(), game.sizeY(), MATRIX_GRID),
+  plantLocs(game.sizeX(), game.sizeY(), MATRIX_GRID)
 {
   update(game);
 }
 
 void Game::RLState::update(const Game& game) {
-  PopulationMatrix pm = game.popMatrixCopy();
-  totalPops = pm.totalPopMatrix();
-  unservicedPops = pm.unservicedPopMatrix();
-  servicedPops = pm.servicedPopMatrix();
+  const PopulationMatrix& pm = game.popMatrixView();
+  assign(totalPops, pm.totalPop());
+  assign(unservicedPops, pm.unservicedPop());
+  assign(servicedPops, pm.servicedPop());
 
-  terrain = game.terrainCopy().getTerrainMatrix();
+  terrain.copyFrom(game.terrainView().terrainView());
 
-  plantLocs.resetToDefault();
-  for (Coord& c : game.plantLocations()) {
-    plantLocs.at(c.x, c.y) = true;
+  for (int i = 0; i < game.sizeX(); i++) {
+    for (int j = 0; j < game.sizeY(); j++) {
+      plantLocs.at(i, j) = game.plant_grid.at(i, j) != 0;
+    }
   }
 }
 
@@ -63,8 +63,8 @@ void GameDisplay::drawAxis() {
 }
 
 void GameDisplay::drawUnserviced() {
-  Terrain terrain = game->terrainCopy();
-  Matrix<int> unserviced_pop_matrix = game->popMatrixCopy().unservicedPopMatrix();
+  const Terrain& terrain = game->terrainView();
+  PopulationLayer unserviced_pop_matrix = game->popMatrixView().unservicedPop();
   for (int i = 0; i < unserviced_pop_matrix.numberRows(); i++) {
     for (int j = 0; j < unserviced_pop_matrix.numberCols(); j++) {
       unsigned char color[3];
@@ -113,7 +113,7 @@ void GameDisplay::drawTerrain() {
   std::pair<int, int> size = game->sizeXY();
   int size_y = size.second;
 
-  Terrain terrain = game->terrainCopy();
+  const Terrain& terrain = game->terrainView();
   for (int i = 0; i < terrain.sizeX(); i++) {
     for (int j = 0; j < terrain.sizeY(); j++) {
       unsigned char color[3];
@@ -167,7 +167,7 @@ void GameDisplay::drawServiced() {
       1.0);
   }
 
-  Matrix<int> serviced_pop_matrix = game->popMatrixCopy().servicedPopMatrix();
+  PopulationLayer serviced_pop_matrix = game->popMatrixView().servicedPop();
   for (int i = 0; i < serviced_pop_matrix.numberRows(); i++) {
     for (int j = 0; j < serviced_pop_matrix.numberCols(); j++) {
       unsigned char color[3];
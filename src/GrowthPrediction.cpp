@@ -1,4 +1,5 @@
 #include "../include/GrowthPrediction.h"
+#include "../include/CoverageCache.h"
 #include "../include/Terrain.h"
 
 #include <cstdlib>
@@ -9,12 +10,12 @@ using namespace MARS;
 
 GrowthPrediction::GrowthPrediction(Game* game, int sample_size):
   game(game),
-  last_pop_matrix(0, 0),
+  last_pop_matrix(game->sizeX(), game->sizeY(), MATRIX_GRID),
   last_diff(0),
   last_diff_slope(0)
 {
   double sum_size = 0;
-  Terrain terrain = game->terrainCopy();
+  const Terrain& terrain = game->terrainView();
   for (int i = 0; i < sample_size; i++) {
     int randx = std::rand() % game->sizeX();
     int randy = std::rand() % game->sizeY();
@@ -24,15 +25,14 @@ GrowthPrediction::GrowthPrediction(Game* game, int sample_size):
       randy = std::rand() % game->sizeY();
       terrain_weight = terrain.weightAtXY(randx, randy);
     }
-    Plant p(game->plantDefaultCapacity(), game->plantServableDistance(), randx, randy, terrain);
-    sum_size += p.serviceableArea().size();
+    sum_size += CoverageCache::shared().get(terrain, Coord(randx, randy), game->plantServableDistance())->size();
   }
   avg_cover = (int) (sum_size / sample_size);
 }
 
-std::unordered_set<Coord> GrowthPrediction::unservicedCoords(bool old) {
-  Matrix<int> unserviced_pop_matrix = game->popMatrixCopy().unservicedPopMatrix();
-  std::unordered_set<Coord> result;
+CoordSet GrowthPrediction::unservicedCoords(bool old) {
+  PopulationLayer unserviced_pop_matrix = game->popMatrixView().unservicedPop();
+  CoordSet result(game->sizeY());
   for (int i = 0; i < game->sizeX(); i++) {
     for (int j = 0; j < game->sizeY(); j++) {
       if (unserviced_pop_matrix.at(i, j) > 0) {
@@ -51,7 +51,7 @@ int GrowthPrediction::binXY() {
   return (int) ((game->plantServableDistance() + std::sqrt(avg_cover)) / 2.0);
 }
 
-Coord GrowthPrediction::nearestValidCoord(Coord c, Terrain& terrain) {
+Coord GrowthPrediction::nearestValidCoord(Coord c, const Terrain& terrain) {
   Coord new_coord = c;
   while (new_coord.x < terrain.sizeX()) {
     if (terrain.weightAtCoord(new_coord) == GRASSLAND_WEIGHT)
@@ -87,16 +87,16 @@ Coord GrowthPrediction::plantLocationInBin(Coord bin) {
   int y = bin.y*binXY();
   x = std::min(x, game->sizeX()-1);
   y = std::min(y, game->sizeY()-1);
-  Terrain terrain = game->terrainCopy();
+  const Terrain& terrain = game->terrainView();
   if (terrain.weightAtXY(x, y) != GRASSLAND_WEIGHT) 
     return nearestValidCoord(Coord(x, y), terrain);
   return Coord(x, y);
 }
 
 std::vector<Coord> GrowthPrediction::predictNewPlants() {
-  Matrix<int> unserviced_pop_matrix = game->popMatrixCopy().unservicedPopMatrix();  
-  std::unordered_set<Coord> unserv_coords = unservicedCoords(false);
-  std::unordered_map<Coord, int> bins;
+  PopulationLayer unserviced_pop_matrix = game->popMatrixView().unservicedPop();
+  CoordSet unserv_coords = unservicedCoords(false);
+  CoordMap<int> bins;
 
   for (Coord c : unserv_coords) {
     int binx = c.x / binXY();
@@ -106,7 +106,7 @@ std::vector<Coord> GrowthPrediction::predictNewPlants() {
   }
 
   std::vector<Coord> result;
-  for (std::pair<Coord, int> element : bins) {
+  for (const std::pair<Coord, int>& element : bins) {
     Coord plant_loc = plantLocationInBin(element.first);
     if (!game->isPlantPresent(plant_loc)) {
       result.push_back(plant_loc);
@@ -117,7 +117,7 @@ std::vector<Coord> GrowthPrediction::predictNewPlants() {
 }
 
 void GrowthPrediction::updateStateRecord() {
-  last_pop_matrix = game->popMatrixCopy().totalPopMatrix();
+  assign(last_pop_matrix, game->popMatrixView().totalPop());
   int diff = game->numberServicedPop() - game->numberUnservicedPop();
   last_diff_slope = diff - last_diff;
   last_diff = diff;
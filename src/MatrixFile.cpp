@@ -0,0 +1,139 @@
+#include "../include/MatrixFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MATRIX_FILE_MAGIC "MARSMAT"
+#define MATRIX_FILE_VERSION 1
+
+using namespace MARS;
+using namespace MARS::detail;
+
+static std::runtime_error fileError(const std::string& what, const std::string& path) {
+  return std::runtime_error(what + " '" + path + "': " + std::strerror(errno));
+}
+
+#ifdef _WIN32
+
+MatrixMapping MARS::detail::createMatrixFile(const std::string& path, MatrixFileHeader&) {
+  throw std::runtime_error("File-backed matrices are not supported on this platform: '" + path + "'");
+}
+
+MatrixMapping MARS::detail::openMatrixFile(const std::string& path, MatrixFileHeader&) {
+  throw std::runtime_error("File-backed matrices are not supported on this platform: '" + path + "'");
+}
+
+bool MARS::detail::readMatrixFileHeader(const std::string&, MatrixFileHeader&) {
+  return false;
+}
+
+void MARS::detail::syncMatrixFile(const MatrixMapping&) {}
+
+void MARS::detail::adviseMatrixFile(const MatrixMapping&, MatrixAccess) {}
+
+void MARS::detail::unmapMatrixFile(const MatrixMapping&) {}
+
+#else
+
+static std::size_t dataBytes(const MatrixFileHeader& header) {
+  return (std::size_t) header.rows * header.stride * header.element_size;
+}
+
+/*
+ * Map `bytes` of an open file read/write, and close the descriptor.
+ */
+static MatrixMapping mapDescriptor(int fd, const std::string& path, std::size_t bytes, std::size_t data_offset) {
+  void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    std::runtime_error error = fileError("Could not map matrix file", path);
+    close(fd);
+    throw error;
+  }
+  close(fd);
+  MatrixMapping mapping;
+  mapping.base = base;
+  mapping.bytes = bytes;
+  mapping.data = static_cast<char*>(base) + data_offset;
+  return mapping;
+}
+
+MatrixMapping MARS::detail::createMatrixFile(const std::string& path, MatrixFileHeader& header) {
+  std::size_t page = (std::size_t) sysconf(_SC_PAGESIZE);
+  std::memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+  header.version = MATRIX_FILE_VERSION;
+  header.data_offset = (sizeof(MatrixFileHeader) + page - 1) / page * page;
+  std::size_t bytes = header.data_offset + dataBytes(header);
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw fileError("Could not create matrix file", path);
+  if (ftruncate(fd, (off_t) bytes) != 0) {
+    std::runtime_error error = fileError("Could not size matrix file", path);
+    close(fd);
+    throw error;
+  }
+  MatrixMapping mapping = mapDescriptor(fd, path, bytes, header.data_offset);
+  std::memcpy(mapping.base, &header, sizeof(MatrixFileHeader));
+  return mapping;
+}
+
+MatrixMapping MARS::detail::openMatrixFile(const std::string& path, MatrixFileHeader& expected) {
+  MatrixFileHeader header;
+  if (!readMatrixFileHeader(path, header))
+    throw std::runtime_error("Matrix file '" + path + "' is missing or is not a matrix file");
+  if (header.dtype != expected.dtype || header.element_size != expected.element_size)
+    throw std::runtime_error("Matrix file '" + path + "' holds a different element type");
+
+  int fd = open(path.c_str(), O_RDWR);
+  if (fd < 0)
+    throw fileError("Could not open matrix file", path);
+  struct stat info;
+  std::size_t bytes = header.data_offset + dataBytes(header);
+  if (fstat(fd, &info) != 0 || (std::size_t) info.st_size < bytes) {
+    close(fd);
+    throw std::runtime_error("Matrix file '" + path + "' is truncated");
+  }
+  expected = header;
+  return mapDescriptor(fd, path, bytes, header.data_offset);
+}
+
+bool MARS::detail::readMatrixFileHeader(const std::string& path, MatrixFileHeader& header) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  ssize_t read_bytes = pread(fd, &header, sizeof(MatrixFileHeader), 0);
+  close(fd);
+  return read_bytes == (ssize_t) sizeof(MatrixFileHeader)
+    && std::memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) == 0
+    && header.version == MATRIX_FILE_VERSION
+    && header.stride >= header.cols;
+}
+
+void MARS::detail::syncMatrixFile(const MatrixMapping& mapping) {
+  msync(mapping.base, mapping.bytes, MS_SYNC);
+}
+
+void MARS::detail::adviseMatrixFile(const MatrixMapping& mapping, MatrixAccess access) {
+  int advice = MADV_NORMAL;
+  switch (access) {
+    case MATRIX_ACCESS_NORMAL: advice = MADV_NORMAL; break;
+    case MATRIX_ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+    case MATRIX_ACCESS_RANDOM: advice = MADV_RANDOM; break;
+    case MATRIX_ACCESS_WILLNEED: advice = MADV_WILLNEED; break;
+  }
+  madvise(mapping.base, mapping.bytes, advice);
+}
+
+void MARS::detail::unmapMatrixFile(const MatrixMapping& mapping) {
+  munmap(mapping.base, mapping.bytes);
+}
+
+#endif
@@ -0,0 +1,1048 @@
+#include "MatrixKernels.h"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define MARS_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(MARS_KERNELS_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MARS_KERNELS_AVX2
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+using namespace MARS;
+
+namespace {
+
+  /*
+   * Scalar row kernels, used for tails and on targets without SIMD support.
+   */
+
+  /* Addition, saturating at the top of the range for the narrow unsigned types */
+  template <class T>
+  T saturatingAdd(T a, T b) {
+    return a + b;
+  }
+
+  inline std::uint8_t saturatingAdd(std::uint8_t a, std::uint8_t b) {
+    unsigned int total = (unsigned int) a + b;
+    return (std::uint8_t) (total > UINT8_MAX ? UINT8_MAX : total);
+  }
+
+  inline std::uint16_t saturatingAdd(std::uint16_t a, std::uint16_t b) {
+    unsigned int total = (unsigned int) a + b;
+    return (std::uint16_t) (total > UINT16_MAX ? UINT16_MAX : total);
+  }
+
+  template <class T>
+  void addRowScalar(const T* a, const T* b, T* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+      out[i] = saturatingAdd(a[i], b[i]);
+    }
+  }
+
+  template <class T, class Acc>
+  Acc sumRowScalar(const T* a, std::size_t n) {
+    Acc total = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      total += a[i];
+    }
+    return total;
+  }
+
+  template <class T, class Acc>
+  Acc sumSquaresRowScalar(const T* a, std::size_t n) {
+    Acc total = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      total += (Acc) a[i] * a[i];
+    }
+    return total;
+  }
+
+  template <class T>
+  T maxRowScalar(const T* a, std::size_t n, T best) {
+    for (std::size_t i = 0; i < n; i++) {
+      best = std::max(best, a[i]);
+    }
+    return best;
+  }
+
+  template <class T>
+  std::size_t countAboveRowScalar(const T* a, std::size_t n, T threshold) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      count += a[i] > threshold;
+    }
+    return count;
+  }
+
+  template <class T>
+  void clampRowScalar(T* a, std::size_t n, T lo, T hi) {
+    for (std::size_t i = 0; i < n; i++) {
+      a[i] = std::min(std::max(a[i], lo), hi);
+    }
+  }
+
+  /* Bitwise operations on 64 bit words, as dest = dest op src */
+  enum BitOp { BIT_AND, BIT_OR, BIT_XOR, BIT_AND_NOT };
+
+  template <BitOp Op>
+  inline std::uint64_t applyBitOp(std::uint64_t dest, std::uint64_t src) {
+    switch (Op) {
+      case BIT_AND: return dest & src;
+      case BIT_OR: return dest | src;
+      case BIT_XOR: return dest ^ src;
+      default: return dest & ~src;
+    }
+  }
+
+  template <BitOp Op>
+  void bitwiseRowScalar(std::uint64_t* dest, const std::uint64_t* src, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+      dest[i] = applyBitOp<Op>(dest[i], src[i]);
+    }
+  }
+
+  inline int popcountWord(std::uint64_t x) {
+    #ifdef __GNUC__
+    return __builtin_popcountll(x);
+    #else
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (int) ((x * 0x0101010101010101ull) >> 56);
+    #endif
+  }
+
+  std::int64_t popcountRowScalar(const std::uint64_t* a, std::size_t n) {
+    std::int64_t total = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      total += popcountWord(a[i]);
+    }
+    return total;
+  }
+
+#ifdef MARS_KERNELS_SSE2
+
+  /*
+   * SSE2 row kernels. SSE2 has no 32 bit integer min/max or multiply, so those
+   * are built out of compares and 32x32->64 bit multiplies.
+   */
+
+  inline __m128i selectSSE2(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+  }
+
+  inline __m128i maxEpi32SSE2(__m128i a, __m128i b) {
+    return selectSSE2(_mm_cmpgt_epi32(a, b), a, b);
+  }
+
+  inline __m128i minEpi32SSE2(__m128i a, __m128i b) {
+    return selectSSE2(_mm_cmplt_epi32(a, b), a, b);
+  }
+
+  inline std::int64_t horizontalSumEpi64SSE2(__m128i acc) {
+    std::int64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    return lanes[0] + lanes[1];
+  }
+
+  inline double horizontalSumPdSSE2(__m128d acc) {
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1];
+  }
+
+  void addRowSSE2(const int* a, const int* b, int* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi32(va, vb));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  void addRowSSE2(const float* a, const float* b, float* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  std::int64_t sumRowSSE2(const int* a, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i sign = _mm_srai_epi32(v, 31);
+      acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+      acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+    }
+    return horizontalSumEpi64SSE2(acc) + sumRowScalar<int, std::int64_t>(a + i, n - i);
+  }
+
+  double sumRowSSE2(const float* a, std::size_t n) {
+    __m128d acc = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128 v = _mm_loadu_ps(a + i);
+      acc = _mm_add_pd(acc, _mm_cvtps_pd(v));
+      acc = _mm_add_pd(acc, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+    return horizontalSumPdSSE2(acc) + sumRowScalar<float, double>(a + i, n - i);
+  }
+
+  std::int64_t sumSquaresRowSSE2(const int* a, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      // |v| as an unsigned value squares exactly with the unsigned 32x32->64 multiply
+      __m128i sign = _mm_srai_epi32(v, 31);
+      __m128i abs = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+      acc = _mm_add_epi64(acc, _mm_mul_epu32(abs, abs));
+      __m128i odd = _mm_srli_epi64(abs, 32);
+      acc = _mm_add_epi64(acc, _mm_mul_epu32(odd, odd));
+    }
+    return horizontalSumEpi64SSE2(acc) + sumSquaresRowScalar<int, std::int64_t>(a + i, n - i);
+  }
+
+  double sumSquaresRowSSE2(const float* a, std::size_t n) {
+    __m128d acc = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128 v = _mm_loadu_ps(a + i);
+      __m128d lo = _mm_cvtps_pd(v);
+      __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+      acc = _mm_add_pd(acc, _mm_mul_pd(lo, lo));
+      acc = _mm_add_pd(acc, _mm_mul_pd(hi, hi));
+    }
+    return horizontalSumPdSSE2(acc) + sumSquaresRowScalar<float, double>(a + i, n - i);
+  }
+
+  int maxRowSSE2(const int* a, std::size_t n, int best) {
+    std::size_t i = 0;
+    if (n >= 4) {
+      __m128i acc = _mm_set1_epi32(best);
+      for (; i + 4 <= n; i += 4) {
+        acc = maxEpi32SSE2(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+      }
+      int lanes[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+      best = maxRowScalar(lanes, 4, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  float maxRowSSE2(const float* a, std::size_t n, float best) {
+    std::size_t i = 0;
+    if (n >= 4) {
+      __m128 acc = _mm_set1_ps(best);
+      for (; i + 4 <= n; i += 4) {
+        acc = _mm_max_ps(acc, _mm_loadu_ps(a + i));
+      }
+      float lanes[4];
+      _mm_storeu_ps(lanes, acc);
+      best = maxRowScalar(lanes, 4, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  std::size_t countAboveRowSSE2(const int* a, std::size_t n, int threshold) {
+    std::size_t count = 0;
+    __m128i limit = _mm_set1_epi32(threshold);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i gt = _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), limit);
+      int mask = _mm_movemask_ps(_mm_castsi128_ps(gt));
+      count += ((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+    return count + countAboveRowScalar(a + i, n - i, threshold);
+  }
+
+  std::size_t countAboveRowSSE2(const float* a, std::size_t n, float threshold) {
+    std::size_t count = 0;
+    __m128 limit = _mm_set1_ps(threshold);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(a + i), limit));
+      count += ((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+    return count + countAboveRowScalar(a + i, n - i, threshold);
+  }
+
+  void clampRowSSE2(int* a, std::size_t n, int lo, int hi) {
+    __m128i vlo = _mm_set1_epi32(lo);
+    __m128i vhi = _mm_set1_epi32(hi);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i* p = reinterpret_cast<__m128i*>(a + i);
+      _mm_storeu_si128(p, minEpi32SSE2(maxEpi32SSE2(_mm_loadu_si128(p), vlo), vhi));
+    }
+    clampRowScalar(a + i, n - i, lo, hi);
+  }
+
+  void clampRowSSE2(float* a, std::size_t n, float lo, float hi) {
+    __m128 vlo = _mm_set1_ps(lo);
+    __m128 vhi = _mm_set1_ps(hi);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      _mm_storeu_ps(a + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(a + i), vlo), vhi));
+    }
+    clampRowScalar(a + i, n - i, lo, hi);
+  }
+
+  /*
+   * SSE2 kernels for narrow unsigned population counts. Additions saturate,
+   * and reductions widen to 32 and then 64 bits before they could overflow.
+   */
+
+  /* Add the four 32 bit lanes of v, as unsigned, into the two 64 bit lanes of acc */
+  inline __m128i addEpu32ToEpi64SSE2(__m128i acc, __m128i v) {
+    __m128i zero = _mm_setzero_si128();
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+    return _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+  }
+
+  void addRowSSE2(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_adds_epu8(va, vb));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  void addRowSSE2(const std::uint16_t* a, const std::uint16_t* b, std::uint16_t* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_adds_epu16(va, vb));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  std::int64_t sumRowSSE2(const std::uint8_t* a, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    return horizontalSumEpi64SSE2(acc) + sumRowScalar<std::uint8_t, std::int64_t>(a + i, n - i);
+  }
+
+  std::int64_t sumRowSSE2(const std::uint16_t* a, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i pairs = _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero));
+      acc = addEpu32ToEpi64SSE2(acc, pairs);
+    }
+    return horizontalSumEpi64SSE2(acc) + sumRowScalar<std::uint16_t, std::int64_t>(a + i, n - i);
+  }
+
+  std::int64_t sumSquaresRowSSE2(const std::uint8_t* a, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+      // Each 16 bit value is at most 255, so the pairwise sums of squares fit easily in 32 bits
+      __m128i squares = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+      acc = addEpu32ToEpi64SSE2(acc, squares);
+    }
+    return horizontalSumEpi64SSE2(acc) + sumSquaresRowScalar<std::uint8_t, std::int64_t>(a + i, n - i);
+  }
+
+  std::int64_t sumSquaresRowSSE2(const std::uint16_t* a, std::size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i halves[2] = { _mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero) };
+      for (__m128i half : halves) {
+        __m128i odd = _mm_srli_epi64(half, 32);
+        acc = _mm_add_epi64(acc, _mm_mul_epu32(half, half));
+        acc = _mm_add_epi64(acc, _mm_mul_epu32(odd, odd));
+      }
+    }
+    return horizontalSumEpi64SSE2(acc) + sumSquaresRowScalar<std::uint16_t, std::int64_t>(a + i, n - i);
+  }
+
+  std::uint8_t maxRowSSE2(const std::uint8_t* a, std::size_t n, std::uint8_t best) {
+    std::size_t i = 0;
+    if (n >= 16) {
+      __m128i acc = _mm_set1_epi8((char) best);
+      for (; i + 16 <= n; i += 16) {
+        acc = _mm_max_epu8(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+      }
+      std::uint8_t lanes[16];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+      best = maxRowScalar(lanes, 16, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  std::uint16_t maxRowSSE2(const std::uint16_t* a, std::size_t n, std::uint16_t best) {
+    std::size_t i = 0;
+    if (n >= 8) {
+      __m128i acc = _mm_set1_epi16((short) best);
+      for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        // SSE2 has no unsigned 16 bit max, but max(a, b) == (a -sat b) + b
+        acc = _mm_add_epi16(_mm_subs_epu16(acc, v), v);
+      }
+      std::uint16_t lanes[8];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+      best = maxRowScalar(lanes, 8, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  template <BitOp Op>
+  inline __m128i bitOpSSE2(__m128i dest, __m128i src) {
+    switch (Op) {
+      case BIT_AND: return _mm_and_si128(dest, src);
+      case BIT_OR: return _mm_or_si128(dest, src);
+      case BIT_XOR: return _mm_xor_si128(dest, src);
+      default: return _mm_andnot_si128(src, dest);
+    }
+  }
+
+  template <BitOp Op>
+  void bitwiseRowSSE2(std::uint64_t* dest, const std::uint64_t* src, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+      __m128i vd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + i));
+      __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), bitOpSSE2<Op>(vd, vs));
+    }
+    bitwiseRowScalar<Op>(dest + i, src + i, n - i);
+  }
+
+  /* SSE2 has no popcount or byte shuffle, so bits are summed in parallel within each byte */
+  std::int64_t popcountRowSSE2(const std::uint64_t* a, std::size_t n) {
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0F);
+    __m128i acc = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+      v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+      v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    return horizontalSumEpi64SSE2(acc) + popcountRowScalar(a + i, n - i);
+  }
+
+#endif // MARS_KERNELS_SSE2
+
+#ifdef MARS_KERNELS_AVX2
+
+  /*
+   * AVX2 row kernels, compiled for AVX2 regardless of the global target flags
+   * and only called once the CPU has been checked for support.
+   */
+
+  AVX2_TARGET std::int64_t horizontalSumEpi64AVX2(__m256i acc) {
+    std::int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+
+  AVX2_TARGET double horizontalSumPdAVX2(__m256d acc) {
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+
+  AVX2_TARGET void addRowAVX2(const int* a, const int* b, int* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi32(va, vb));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  AVX2_TARGET void addRowAVX2(const float* a, const float* b, float* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  AVX2_TARGET std::int64_t sumRowAVX2(const int* a, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+      acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+    return horizontalSumEpi64AVX2(acc) + sumRowScalar<int, std::int64_t>(a + i, n - i);
+  }
+
+  AVX2_TARGET double sumRowAVX2(const float* a, std::size_t n) {
+    __m256d acc = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256 v = _mm256_loadu_ps(a + i);
+      acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+      acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+    }
+    return horizontalSumPdAVX2(acc) + sumRowScalar<float, double>(a + i, n - i);
+  }
+
+  AVX2_TARGET std::int64_t sumSquaresRowAVX2(const int* a, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      acc = _mm256_add_epi64(acc, _mm256_mul_epi32(v, v));
+      __m256i odd = _mm256_srli_epi64(v, 32);
+      acc = _mm256_add_epi64(acc, _mm256_mul_epi32(odd, odd));
+    }
+    return horizontalSumEpi64AVX2(acc) + sumSquaresRowScalar<int, std::int64_t>(a + i, n - i);
+  }
+
+  AVX2_TARGET double sumSquaresRowAVX2(const float* a, std::size_t n) {
+    __m256d acc = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256 v = _mm256_loadu_ps(a + i);
+      __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+      __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+      acc = _mm256_add_pd(acc, _mm256_mul_pd(lo, lo));
+      acc = _mm256_add_pd(acc, _mm256_mul_pd(hi, hi));
+    }
+    return horizontalSumPdAVX2(acc) + sumSquaresRowScalar<float, double>(a + i, n - i);
+  }
+
+  AVX2_TARGET int maxRowAVX2(const int* a, std::size_t n, int best) {
+    std::size_t i = 0;
+    if (n >= 8) {
+      __m256i acc = _mm256_set1_epi32(best);
+      for (; i + 8 <= n; i += 8) {
+        acc = _mm256_max_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+      }
+      int lanes[8];
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+      best = maxRowScalar(lanes, 8, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  AVX2_TARGET float maxRowAVX2(const float* a, std::size_t n, float best) {
+    std::size_t i = 0;
+    if (n >= 8) {
+      __m256 acc = _mm256_set1_ps(best);
+      for (; i + 8 <= n; i += 8) {
+        acc = _mm256_max_ps(acc, _mm256_loadu_ps(a + i));
+      }
+      float lanes[8];
+      _mm256_storeu_ps(lanes, acc);
+      best = maxRowScalar(lanes, 8, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  AVX2_TARGET std::size_t countAboveRowAVX2(const int* a, std::size_t n, int threshold) {
+    std::size_t count = 0;
+    __m256i limit = _mm256_set1_epi32(threshold);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i gt = _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), limit);
+      count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(gt)));
+    }
+    return count + countAboveRowScalar(a + i, n - i, threshold);
+  }
+
+  AVX2_TARGET std::size_t countAboveRowAVX2(const float* a, std::size_t n, float threshold) {
+    std::size_t count = 0;
+    __m256 limit = _mm256_set1_ps(threshold);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      count += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a + i), limit, _CMP_GT_OQ)));
+    }
+    return count + countAboveRowScalar(a + i, n - i, threshold);
+  }
+
+  AVX2_TARGET void clampRowAVX2(int* a, std::size_t n, int lo, int hi) {
+    __m256i vlo = _mm256_set1_epi32(lo);
+    __m256i vhi = _mm256_set1_epi32(hi);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i* p = reinterpret_cast<__m256i*>(a + i);
+      _mm256_storeu_si256(p, _mm256_min_epi32(_mm256_max_epi32(_mm256_loadu_si256(p), vlo), vhi));
+    }
+    clampRowScalar(a + i, n - i, lo, hi);
+  }
+
+  AVX2_TARGET void clampRowAVX2(float* a, std::size_t n, float lo, float hi) {
+    __m256 vlo = _mm256_set1_ps(lo);
+    __m256 vhi = _mm256_set1_ps(hi);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      _mm256_storeu_ps(a + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(a + i), vlo), vhi));
+    }
+    clampRowScalar(a + i, n - i, lo, hi);
+  }
+
+  AVX2_TARGET __m256i addEpu32ToEpi64AVX2(__m256i acc, __m256i v) {
+    __m256i zero = _mm256_setzero_si256();
+    acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(v, zero));
+    return _mm256_add_epi64(acc, _mm256_unpackhi_epi32(v, zero));
+  }
+
+  AVX2_TARGET void addRowAVX2(const std::uint8_t* a, const std::uint8_t* b, std::uint8_t* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_adds_epu8(va, vb));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  AVX2_TARGET void addRowAVX2(const std::uint16_t* a, const std::uint16_t* b, std::uint16_t* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_adds_epu16(va, vb));
+    }
+    addRowScalar(a + i, b + i, out + i, n - i);
+  }
+
+  AVX2_TARGET std::int64_t sumRowAVX2(const std::uint8_t* a, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+    }
+    return horizontalSumEpi64AVX2(acc) + sumRowScalar<std::uint8_t, std::int64_t>(a + i, n - i);
+  }
+
+  AVX2_TARGET std::int64_t sumRowAVX2(const std::uint16_t* a, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i pairs = _mm256_add_epi32(_mm256_unpacklo_epi16(v, zero), _mm256_unpackhi_epi16(v, zero));
+      acc = addEpu32ToEpi64AVX2(acc, pairs);
+    }
+    return horizontalSumEpi64AVX2(acc) + sumRowScalar<std::uint16_t, std::int64_t>(a + i, n - i);
+  }
+
+  AVX2_TARGET std::int64_t sumSquaresRowAVX2(const std::uint8_t* a, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i lo = _mm256_unpacklo_epi8(v, zero);
+      __m256i hi = _mm256_unpackhi_epi8(v, zero);
+      __m256i squares = _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi));
+      acc = addEpu32ToEpi64AVX2(acc, squares);
+    }
+    return horizontalSumEpi64AVX2(acc) + sumSquaresRowScalar<std::uint8_t, std::int64_t>(a + i, n - i);
+  }
+
+  AVX2_TARGET std::int64_t sumSquaresRowAVX2(const std::uint16_t* a, std::size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i lo = _mm256_unpacklo_epi16(v, zero);
+      __m256i hi = _mm256_unpackhi_epi16(v, zero);
+      acc = _mm256_add_epi64(acc, _mm256_mul_epu32(lo, lo));
+      acc = _mm256_add_epi64(acc, _mm256_mul_epu32(_mm256_srli_epi64(lo, 32), _mm256_srli_epi64(lo, 32)));
+      acc = _mm256_add_epi64(acc, _mm256_mul_epu32(hi, hi));
+      acc = _mm256_add_epi64(acc, _mm256_mul_epu32(_mm256_srli_epi64(hi, 32), _mm256_srli_epi64(hi, 32)));
+    }
+    return horizontalSumEpi64AVX2(acc) + sumSquaresRowScalar<std::uint16_t, std::int64_t>(a + i, n - i);
+  }
+
+  AVX2_TARGET std::uint8_t maxRowAVX2(const std::uint8_t* a, std::size_t n, std::uint8_t best) {
+    std::size_t i = 0;
+    if (n >= 32) {
+      __m256i acc = _mm256_set1_epi8((char) best);
+      for (; i + 32 <= n; i += 32) {
+        acc = _mm256_max_epu8(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+      }
+      std::uint8_t lanes[32];
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+      best = maxRowScalar(lanes, 32, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  AVX2_TARGET std::uint16_t maxRowAVX2(const std::uint16_t* a, std::size_t n, std::uint16_t best) {
+    std::size_t i = 0;
+    if (n >= 16) {
+      __m256i acc = _mm256_set1_epi16((short) best);
+      for (; i + 16 <= n; i += 16) {
+        acc = _mm256_max_epu16(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+      }
+      std::uint16_t lanes[16];
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+      best = maxRowScalar(lanes, 16, best);
+    }
+    return maxRowScalar(a + i, n - i, best);
+  }
+
+  template <BitOp Op>
+  AVX2_TARGET inline __m256i bitOpAVX2(__m256i dest, __m256i src) {
+    switch (Op) {
+      case BIT_AND: return _mm256_and_si256(dest, src);
+      case BIT_OR: return _mm256_or_si256(dest, src);
+      case BIT_XOR: return _mm256_xor_si256(dest, src);
+      default: return _mm256_andnot_si256(src, dest);
+    }
+  }
+
+  template <BitOp Op>
+  AVX2_TARGET void bitwiseRowAVX2(std::uint64_t* dest, const std::uint64_t* src, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m256i vd = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+      __m256i vs = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), bitOpAVX2<Op>(vd, vs));
+    }
+    bitwiseRowScalar<Op>(dest + i, src + i, n - i);
+  }
+
+  /* Counts each nibble with a 16 entry byte shuffle table, then sums the bytes */
+  AVX2_TARGET std::int64_t popcountRowAVX2(const std::uint64_t* a, std::size_t n) {
+    const __m256i table = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0F);
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low_nibbles));
+      __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+    return horizontalSumEpi64AVX2(acc) + popcountRowScalar(a + i, n - i);
+  }
+
+#endif // MARS_KERNELS_AVX2
+
+  bool hasAVX2() {
+    #ifdef MARS_KERNELS_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+    #else
+    return false;
+    #endif
+  }
+
+  /*
+   * Row dispatch: AVX2 when available, then SSE2, then scalar.
+   */
+
+  template <class T>
+  void addRow(const T* a, const T* b, T* out, std::size_t n) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return addRowAVX2(a, b, out, n);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return addRowSSE2(a, b, out, n);
+    #else
+    return addRowScalar(a, b, out, n);
+    #endif
+  }
+
+  template <class T, class Acc>
+  Acc sumRow(const T* a, std::size_t n) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return sumRowAVX2(a, n);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return sumRowSSE2(a, n);
+    #else
+    return sumRowScalar<T, Acc>(a, n);
+    #endif
+  }
+
+  template <class T, class Acc>
+  Acc sumSquaresRow(const T* a, std::size_t n) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return sumSquaresRowAVX2(a, n);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return sumSquaresRowSSE2(a, n);
+    #else
+    return sumSquaresRowScalar<T, Acc>(a, n);
+    #endif
+  }
+
+  template <class T>
+  T maxRow(const T* a, std::size_t n, T best) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return maxRowAVX2(a, n, best);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return maxRowSSE2(a, n, best);
+    #else
+    return maxRowScalar(a, n, best);
+    #endif
+  }
+
+  template <class T>
+  std::size_t countAboveRow(const T* a, std::size_t n, T threshold) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return countAboveRowAVX2(a, n, threshold);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return countAboveRowSSE2(a, n, threshold);
+    #else
+    return countAboveRowScalar(a, n, threshold);
+    #endif
+  }
+
+  template <class T>
+  void clampRow(T* a, std::size_t n, T lo, T hi) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return clampRowAVX2(a, n, lo, hi);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return clampRowSSE2(a, n, lo, hi);
+    #else
+    return clampRowScalar(a, n, lo, hi);
+    #endif
+  }
+
+  template <BitOp Op>
+  void bitwiseRow(std::uint64_t* dest, const std::uint64_t* src, std::size_t n) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return bitwiseRowAVX2<Op>(dest, src, n);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return bitwiseRowSSE2<Op>(dest, src, n);
+    #else
+    return bitwiseRowScalar<Op>(dest, src, n);
+    #endif
+  }
+
+  std::int64_t popcountRow(const std::uint64_t* a, std::size_t n) {
+    #ifdef MARS_KERNELS_AVX2
+    if (hasAVX2()) return popcountRowAVX2(a, n);
+    #endif
+    #ifdef MARS_KERNELS_SSE2
+    return popcountRowSSE2(a, n);
+    #else
+    return popcountRowScalar(a, n);
+    #endif
+  }
+
+  /*
+   * Whole matrix drivers
+   */
+
+  template <class T>
+  void addMatrix(const MatrixView<T>& a, const MatrixView<T>& b, Matrix<T>& out) {
+    for (unsigned int r = 0; r < out.numberRows(); r++) {
+      addRow(a.rowPtr(r), b.rowPtr(r), out.rowPtr(r), out.numberCols());
+    }
+  }
+
+  template <class T, class Acc>
+  Acc sumMatrix(const MatrixView<T>& m) {
+    Acc total = 0;
+    for (unsigned int r = 0; r < m.numberRows(); r++) {
+      total += sumRow<T, Acc>(m.rowPtr(r), m.numberCols());
+    }
+    return total;
+  }
+
+  template <class T, class Acc>
+  Acc sumSquaresMatrix(const MatrixView<T>& m) {
+    Acc total = 0;
+    for (unsigned int r = 0; r < m.numberRows(); r++) {
+      total += sumSquaresRow<T, Acc>(m.rowPtr(r), m.numberCols());
+    }
+    return total;
+  }
+
+  template <class T>
+  T maxMatrix(const MatrixView<T>& m) {
+    T best = std::numeric_limits<T>::lowest();
+    for (unsigned int r = 0; r < m.numberRows(); r++) {
+      best = maxRow(m.rowPtr(r), m.numberCols(), best);
+    }
+    return best;
+  }
+
+  template <class T>
+  std::size_t countAboveMatrix(const MatrixView<T>& m, T threshold) {
+    std::size_t count = 0;
+    for (unsigned int r = 0; r < m.numberRows(); r++) {
+      count += countAboveRow(m.rowPtr(r), m.numberCols(), threshold);
+    }
+    return count;
+  }
+
+  template <class T>
+  void clampMatrix(Matrix<T>& m, T lo, T hi) {
+    for (unsigned int r = 0; r < m.numberRows(); r++) {
+      clampRow(m.rowPtr(r), m.numberCols(), lo, hi);
+    }
+  }
+
+  template <BitOp Op>
+  void bitwiseMatrix(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src) {
+    for (unsigned int r = 0; r < dest.numberRows(); r++) {
+      bitwiseRow<Op>(dest.rowPtr(r), src.rowPtr(r), dest.numberCols());
+    }
+  }
+}
+
+void MatrixKernels::add(const MatrixView<int>& a, const MatrixView<int>& b, Matrix<int>& out) {
+  addMatrix(a, b, out);
+}
+
+void MatrixKernels::add(const MatrixView<float>& a, const MatrixView<float>& b, Matrix<float>& out) {
+  addMatrix(a, b, out);
+}
+
+void MatrixKernels::addInto(Matrix<int>& dest, const MatrixView<int>& src) {
+  addMatrix(dest.view(), src, dest);
+}
+
+void MatrixKernels::addInto(Matrix<float>& dest, const MatrixView<float>& src) {
+  addMatrix(dest.view(), src, dest);
+}
+
+std::int64_t MatrixKernels::sum(const MatrixView<int>& m) {
+  return sumMatrix<int, std::int64_t>(m);
+}
+
+double MatrixKernels::sum(const MatrixView<float>& m) {
+  return sumMatrix<float, double>(m);
+}
+
+std::int64_t MatrixKernels::sumOfSquares(const MatrixView<int>& m) {
+  return sumSquaresMatrix<int, std::int64_t>(m);
+}
+
+double MatrixKernels::sumOfSquares(const MatrixView<float>& m) {
+  return sumSquaresMatrix<float, double>(m);
+}
+
+int MatrixKernels::max(const MatrixView<int>& m) {
+  return maxMatrix(m);
+}
+
+float MatrixKernels::max(const MatrixView<float>& m) {
+  return maxMatrix(m);
+}
+
+std::size_t MatrixKernels::countAbove(const MatrixView<int>& m, int threshold) {
+  return countAboveMatrix(m, threshold);
+}
+
+std::size_t MatrixKernels::countAbove(const MatrixView<float>& m, float threshold) {
+  return countAboveMatrix(m, threshold);
+}
+
+void MatrixKernels::clamp(Matrix<int>& m, int lo, int hi) {
+  clampMatrix(m, lo, hi);
+}
+
+void MatrixKernels::clamp(Matrix<float>& m, float lo, float hi) {
+  clampMatrix(m, lo, hi);
+}
+
+void MatrixKernels::add(const MatrixView<std::uint8_t>& a, const MatrixView<std::uint8_t>& b, Matrix<std::uint8_t>& out) {
+  addMatrix(a, b, out);
+}
+
+void MatrixKernels::add(const MatrixView<std::uint16_t>& a, const MatrixView<std::uint16_t>& b, Matrix<std::uint16_t>& out) {
+  addMatrix(a, b, out);
+}
+
+void MatrixKernels::addInto(Matrix<std::uint8_t>& dest, const MatrixView<std::uint8_t>& src) {
+  addMatrix(dest.view(), src, dest);
+}
+
+void MatrixKernels::addInto(Matrix<std::uint16_t>& dest, const MatrixView<std::uint16_t>& src) {
+  addMatrix(dest.view(), src, dest);
+}
+
+std::int64_t MatrixKernels::sum(const MatrixView<std::uint8_t>& m) {
+  return sumMatrix<std::uint8_t, std::int64_t>(m);
+}
+
+std::int64_t MatrixKernels::sum(const MatrixView<std::uint16_t>& m) {
+  return sumMatrix<std::uint16_t, std::int64_t>(m);
+}
+
+std::int64_t MatrixKernels::sumOfSquares(const MatrixView<std::uint8_t>& m) {
+  return sumSquaresMatrix<std::uint8_t, std::int64_t>(m);
+}
+
+std::int64_t MatrixKernels::sumOfSquares(const MatrixView<std::uint16_t>& m) {
+  return sumSquaresMatrix<std::uint16_t, std::int64_t>(m);
+}
+
+std::uint8_t MatrixKernels::max(const MatrixView<std::uint8_t>& m) {
+  return maxMatrix(m);
+}
+
+std::uint16_t MatrixKernels::max(const MatrixView<std::uint16_t>& m) {
+  return maxMatrix(m);
+}
+
+void MatrixKernels::andInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src) {
+  bitwiseMatrix<BIT_AND>(dest, src);
+}
+
+void MatrixKernels::orInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src) {
+  bitwiseMatrix<BIT_OR>(dest, src);
+}
+
+void MatrixKernels::xorInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src) {
+  bitwiseMatrix<BIT_XOR>(dest, src);
+}
+
+void MatrixKernels::andNotInto(Matrix<std::uint64_t>& dest, const MatrixView<std::uint64_t>& src) {
+  bitwiseMatrix<BIT_AND_NOT>(dest, src);
+}
+
+std::int64_t MatrixKernels::popcount(const MatrixView<std::uint64_t>& m) {
+  std::int64_t total = 0;
+  for (unsigned int r = 0; r < m.numberRows(); r++) {
+    total += popcountRow(m.rowPtr(r), m.numberCols());
+  }
+  return total;
+}
+
+bool MatrixKernels::usingAVX2() {
+  return hasAVX2();
+}
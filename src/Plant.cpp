@@ -1,6 +1,7 @@
 #include "Plant.h"
-#include <queue>
+#include "CoverageCache.h"
 #include <iostream>
+#include <stdexcept>
 
 using namespace MARS;
 
@@ -9,96 +10,59 @@ Plant::Plant(
   double serve_dist,
   int x,
   int y,
-  Terrain &terrain
+  const Terrain &terrain
 ) :
   capacity(cap),
   serviceable_distance(serve_dist),
   location(Coord(x,y)),
   in_service(0),
   serviceable_area(generateServiceableArea(terrain, Coord(x,y), serve_dist)),
-  serviced_map(initializeServicedMap(serviceable_area))
+  serviced_map(initializeServicedMap(*serviceable_area))
 {
 
 }
 
-std::unordered_map<Coord,double> Plant::generateServiceableArea(const Terrain &terrain, const Coord& plantLoc, double serve_dist) {
-  BitMatrix visited = BitMatrix(terrain.sizeX(), terrain.sizeY());
-
-  std::queue<std::tuple<Coord, double>> queue;
-  std::unordered_map<Coord, double> serviceable;
-  serviceable[plantLoc] = 0.0;
-  queue.push(std::make_tuple(plantLoc, 0.0));
-  visited.set(plantLoc.x, plantLoc.y, true);
-
-  while (queue.size() > 0) {
-    std::tuple<Coord, double> locInfo = queue.front();
-    double weightedDist = std::get<1>(locInfo);
-    Coord loc = std::get<0>(locInfo);
-    queue.pop();
-
-    std::vector<Coord> neighbors {
-      Coord(loc.x, loc.y-1), 
-      Coord(loc.x, loc.y+1), 
-      Coord(loc.x-1, loc.y), 
-      Coord(loc.x+1, loc.y)
-    };
-
-    for (int i = 0; i < neighbors.size(); i++) {
-      Coord neighbor = neighbors[i];
-      if (!(neighbor.x >= 0 && neighbor.y >= 0 
-      && neighbor.x < terrain.sizeX() && neighbor.y < terrain.sizeY()))
-        continue;
-      if (!visited.get(neighbor.x, neighbor.y)) { // has not been visited
-        double terrainWeight = terrain.weightAtXY(neighbor.x, neighbor.y);
-        if (weightedDist+terrainWeight <= serve_dist ) { // within service
-          std::tuple<Coord, double> newLoc = std::make_tuple(neighbor, weightedDist+terrainWeight);
-          serviceable[neighbor] =  weightedDist+terrainWeight;
-          queue.push(newLoc);
-        }
-      }
-      visited.set(neighbor.x, neighbor.y, true);
-    }
-  }
-
+std::shared_ptr<const CoverageStencil> Plant::generateServiceableArea(const Terrain &terrain, const Coord& plantLoc, double serve_dist) {
+  return CoverageCache::shared().get(terrain, plantLoc, serve_dist);
+}
 
-  return serviceable;
+std::vector<int> Plant::initializeServicedMap(const CoverageStencil& serviceable_area) {
+  return std::vector<int>(serviceable_area.size(), 0);
 }
 
-std::unordered_map<Coord, int> Plant::initializeServicedMap(std::unordered_map<Coord, double> serviceable_area) {
-  std::unordered_map<Coord, int> serviced_map;
-  for (std::pair<Coord, double> element : serviceable_area) {
-    Coord coord = element.first;
-    serviced_map[coord] = 0;
-  }
-  return serviced_map;
+/*
+ * Position of c in the serviceable area. Throws std::out_of_range if the
+ * plant cannot serve c.
+ */
+static std::size_t positionOf(const CoverageStencil& area, const Coord& c) {
+  int i = area.find(c);
+  if (i < 0)
+    throw std::out_of_range("Coord not serviceable by plant");
+  return i;
 }
 
 bool Plant::isServiceableCoord(const Coord& c) const {
-  std::unordered_map<Coord, double>::const_iterator iter = this->serviceable_area.find(c);
-  if (iter == this->serviceable_area.end()) {
-    return false;
-  }
-  return true;
+  return serviceable_area->contains(c);
 }
 
 double Plant::distanceToCoord(const Coord& c) const {
-  return serviceable_area.at(c);
+  return serviceable_area->distanceAt(positionOf(*serviceable_area, c));
 }
 
 int Plant::numberServicedAtCoord(const Coord& c) const {
-  return serviced_map.at(c);
+  return serviced_map[positionOf(*serviceable_area, c)];
 }
 
 void Plant::changeServicedPop(const Coord& person_loc, int pop) {
-  this->serviced_map[person_loc] += pop;
+  this->serviced_map[positionOf(*serviceable_area, person_loc)] += pop;
   this->in_service += pop;
 }
 
-std::unordered_map<Coord, double> Plant::serviceableArea() const {
-  return serviceable_area;
+const CoverageStencil& Plant::serviceableArea() const {
+  return *serviceable_area;
 }
 
-std::unordered_map<Coord, int> Plant::servicedMap() const {
+const std::vector<int>& Plant::servicedMap() const {
   return serviced_map;
 }
 
@@ -0,0 +1,61 @@
+#include "../include/PlantAssignments.h"
+
+using namespace MARS;
+
+PlantAssignments::PlantAssignments(int rows, int cols):
+  cells(rows, cols),
+  overflow(std::make_shared<OverflowLists>())
+{
+}
+
+PlantAssignments::OverflowLists& PlantAssignments::writeOverflow() {
+  if (overflow.use_count() > 1)
+    overflow = std::make_shared<OverflowLists>(*overflow);
+  return *overflow;
+}
+
+int PlantAssignments::count(int x, int y, PlantHandle plant) const {
+  const Cell& cell = cells.at(x, y);
+  if (cell.first.plant == plant)
+    return cell.first.count;
+  if (cell.overflow == 0)
+    return 0;
+  for (const Entry& entry : (*overflow)[cell.overflow - 1]) {
+    if (entry.plant == plant)
+      return entry.count;
+  }
+  return 0;
+}
+
+void PlantAssignments::add(int x, int y, PlantHandle plant, int delta) {
+  Cell& cell = cells.at(x, y);
+  if (cell.first.plant == plant) {
+    cell.first.count += delta;
+    return;
+  }
+  if (cell.first.plant.isNull()) {
+    cell.first = Entry(plant, delta);
+    return;
+  }
+  OverflowLists& lists = writeOverflow();
+  if (cell.overflow == 0) {
+    lists.push_back(std::vector<Entry>());
+    cell.overflow = (std::uint32_t) lists.size();
+  }
+  std::vector<Entry>& list = lists[cell.overflow - 1];
+  for (Entry& entry : list) {
+    if (entry.plant == plant) {
+      entry.count += delta;
+      return;
+    }
+  }
+  list.push_back(Entry(plant, delta));
+}
+
+std::size_t PlantAssignments::memoryUsage() const {
+  std::size_t bytes = (std::size_t) cells.numberRows() * cells.numberCols() * sizeof(Cell);
+  bytes += overflow->capacity() * sizeof(std::vector<Entry>);
+  for (const std::vector<Entry>& list : *overflow)
+    bytes += list.capacity() * sizeof(Entry);
+  return bytes;
+}
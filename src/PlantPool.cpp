@@ -0,0 +1,134 @@
+#include "../include/PlantPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../include/CoverageCache.h"
+
+using namespace MARS;
+
+PlantPool::PlantPool():
+  number_live(0)
+{
+}
+
+std::uint32_t PlantPool::index(PlantHandle plant) const {
+  if (!contains(plant))
+    throw std::out_of_range("Plant handle does not refer to a plant in the pool");
+  return plant.id;
+}
+
+std::size_t PlantPool::positionOf(std::uint32_t id, const Coord& c) const {
+  int i = coverage[id]->find(c);
+  if (i < 0)
+    throw std::out_of_range("Coord not serviceable by plant");
+  return i;
+}
+
+PlantHandle PlantPool::create(const Coord& location, int capacity, double serve_dist, const Terrain& terrain) {
+  std::shared_ptr<const CoverageStencil> area = CoverageCache::shared().get(terrain, location, serve_dist);
+  std::uint32_t length = (std::uint32_t) area->size();
+
+  std::uint32_t id;
+  if (free_ids.empty()) {
+    id = (std::uint32_t) generations.size();
+    generations.push_back(0);
+    locations.push_back(location);
+    capacities.push_back(0);
+    in_service.push_back(0);
+    serve_dists.push_back(0);
+    coverage.push_back(nullptr);
+    coverage_offsets.push_back(0);
+    run_lengths.push_back(0);
+  } else {
+    id = free_ids.back();
+    free_ids.pop_back();
+  }
+
+  // Reuse the slot's old run of served counts if the new area fits in it
+  if (length > run_lengths[id]) {
+    coverage_offsets[id] = (std::uint32_t) served.size();
+    run_lengths[id] = length;
+    served.resize(served.size() + length);
+  }
+  std::fill(served.begin() + coverage_offsets[id], served.begin() + coverage_offsets[id] + length, 0);
+
+  generations[id]++;
+  locations[id] = location;
+  capacities[id] = capacity;
+  in_service[id] = 0;
+  serve_dists[id] = serve_dist;
+  coverage[id] = area;
+  number_live++;
+  return PlantHandle(id, generations[id]);
+}
+
+void PlantPool::remove(PlantHandle plant) {
+  std::uint32_t id = index(plant);
+  generations[id]++;
+  coverage[id].reset();
+  free_ids.push_back(id);
+  number_live--;
+}
+
+bool PlantPool::contains(PlantHandle plant) const {
+  return plant.id < generations.size() && generations[plant.id] == plant.generation && (plant.generation & 1);
+}
+
+std::size_t PlantPool::size() const {
+  return number_live;
+}
+
+std::size_t PlantPool::numberSlots() const {
+  return generations.size();
+}
+
+PlantHandle PlantPool::handleAt(std::uint32_t id) const {
+  if (id >= generations.size() || !(generations[id] & 1))
+    return PlantHandle();
+  return PlantHandle(id, generations[id]);
+}
+
+const Coord& PlantPool::location(PlantHandle plant) const {
+  return locations[index(plant)];
+}
+
+int PlantPool::capacity(PlantHandle plant) const {
+  return capacities[index(plant)];
+}
+
+int PlantPool::inService(PlantHandle plant) const {
+  return in_service[index(plant)];
+}
+
+int PlantPool::remainingCapacity(PlantHandle plant) const {
+  return remainingCapacityOf(index(plant));
+}
+
+double PlantPool::serveDistance(PlantHandle plant) const {
+  return serve_dists[index(plant)];
+}
+
+const CoverageStencil& PlantPool::serviceableArea(PlantHandle plant) const {
+  return *coverage[index(plant)];
+}
+
+bool PlantPool::isServiceableCoord(PlantHandle plant, const Coord& c) const {
+  return coverage[index(plant)]->contains(c);
+}
+
+double PlantPool::distanceToCoord(PlantHandle plant, const Coord& c) const {
+  std::uint32_t id = index(plant);
+  return coverage[id]->distanceAt(positionOf(id, c));
+}
+
+int PlantPool::numberServicedAtCoord(PlantHandle plant, const Coord& c) const {
+  std::uint32_t id = index(plant);
+  return served[coverage_offsets[id] + positionOf(id, c)];
+}
+
+void PlantPool::changeServicedPop(PlantHandle plant, const Coord& c, int pop) {
+  std::uint32_t id = index(plant);
+  served[coverage_offsets[id] + positionOf(id, c)] += pop;
+  in_service[id] += pop;
+}
@@ -1,91 +1,246 @@
 #include "../include/PopulationMatrix.h"
+#include "../include/MatrixExpr.h"
+#include "../include/MatrixKernels.h"
+
+#include <algorithm>
+#include <stdexcept>
 
 using namespace MARS;
 
-PopulationMatrix::PopulationMatrix(int dx, int dy):
-  serviced_pop_matrix(dx, dy),
-  unserviced_pop_matrix(dx, dy),
-  plant_assign_matrix(dx, dy) 
+static Matrix<PopCount> populationLayer(int dx, int dy, const std::string& path, const std::string& layer, bool sparse) {
+  if (sparse) {
+    if (!path.empty())
+      throw std::invalid_argument("Sparse populations cannot be kept in files");
+    return Matrix<PopCount>(0, 0);
+  }
+  if (path.empty())
+    return Matrix<PopCount>(dx, dy, MATRIX_GRID);
+  return Matrix<PopCount>::createFile(path + "." + layer + ".mat", dx, dy, MATRIX_PADDED);
+}
+
+static void requireDense(bool sparse) {
+  if (sparse)
+    throw std::logic_error("Sparse population layers have no contiguous view");
+}
+
+PopulationMatrix::PopulationMatrix(int dx, int dy, const std::string& path, bool sparse):
+  sparse(sparse),
+  serviced_pop_matrix(populationLayer(dx, dy, path, "serviced", sparse)),
+  unserviced_pop_matrix(populationLayer(dx, dy, path, "unserviced", sparse)),
+  sparse_serviced_pop(sparse ? dx : 0, sparse ? dy : 0),
+  sparse_unserviced_pop(sparse ? dx : 0, sparse ? dy : 0),
+  plant_assign_matrix(dx, dy),
+  row_totals(dx, NUMBER_TOTALS)
 {
+  std::fill(totals, totals + NUMBER_TOTALS, 0);
+}
 
+void PopulationMatrix::countDenseRow(unsigned int r, std::int64_t* counts) const {
+  const Matrix<PopCount>* layers[2] = {&unserviced_pop_matrix.read(), &serviced_pop_matrix.read()};
+  const int columns[2] = {UNSERVICED_SUM, SERVICED_SUM};
+  for (int l = 0; l < 2; l++) {
+    const PopCount* row = layers[l]->rowPtr(r);
+    for (unsigned int c = 0; c < layers[l]->numberCols(); c++) {
+      counts[columns[l]] += row[c];
+      counts[columns[l] + 1] += (std::int64_t) row[c] * row[c];
+    }
+  }
+}
+
+void PopulationMatrix::countRowTotals(Matrix<std::int64_t>& counts) const {
+  if (!sparse) {
+    for (unsigned int r = 0; r < counts.numberRows(); r++)
+      countDenseRow(r, &counts.at(r, 0));
+    return;
+  }
+  const SparseTileMatrix<PopCount>* layers[2] = {&sparse_unserviced_pop, &sparse_serviced_pop};
+  const int columns[2] = {UNSERVICED_SUM, SERVICED_SUM};
+  for (int l = 0; l < 2; l++) {
+    for (SparseTileMatrix<PopCount>::TileRef tile : layers[l]->nonEmptyTiles()) {
+      for (unsigned int r = 0; r < tile.numberRows(); r++) {
+        for (unsigned int c = 0; c < tile.numberCols(); c++) {
+          counts.at(tile.row() + r, columns[l]) += tile.at(r, c);
+          counts.at(tile.row() + r, columns[l] + 1) += (std::int64_t) tile.at(r, c) * tile.at(r, c);
+        }
+      }
+    }
+  }
+}
+
+void PopulationMatrix::recountTotals() {
+  Matrix<std::int64_t>& rows = row_totals.write();
+  for (unsigned int r = 0; r < rows.numberRows(); r++)
+    std::fill(&rows.at(r, 0), &rows.at(r, 0) + NUMBER_TOTALS, 0);
+  countRowTotals(rows);
+  sumRowTotals();
+}
+
+void PopulationMatrix::sumRowTotals() {
+  const Matrix<std::int64_t>& rows = row_totals.read();
+  std::fill(totals, totals + NUMBER_TOTALS, 0);
+  for (unsigned int r = 0; r < rows.numberRows(); r++) {
+    for (int t = 0; t < NUMBER_TOTALS; t++)
+      totals[t] += rows.at(r, t);
+  }
+}
+
+void PopulationMatrix::changeTotals(int sum_column, unsigned int row, PopCount before, PopCount after) {
+  std::int64_t sum_change = (std::int64_t) after - before;
+  std::int64_t squares_change = (std::int64_t) after * after - (std::int64_t) before * before;
+  Matrix<std::int64_t>& rows = row_totals.write();
+  rows.at(row, sum_column) += sum_change;
+  rows.at(row, sum_column + 1) += squares_change;
+  totals[sum_column] += sum_change;
+  totals[sum_column + 1] += squares_change;
+}
+
+bool PopulationMatrix::totalsConsistent() const {
+  const Matrix<std::int64_t>& rows = row_totals.read();
+  std::int64_t recounted[NUMBER_TOTALS] = {0, 0, 0, 0};
+  auto checkRow = [&](unsigned int r, const std::int64_t* counts) {
+    for (int t = 0; t < NUMBER_TOTALS; t++)
+      recounted[t] += counts[t];
+    return std::equal(counts, counts + NUMBER_TOTALS, &rows.at(r, 0));
+  };
+  if (sparse) {
+    Matrix<std::int64_t> counts(rows.numberRows(), NUMBER_TOTALS);
+    countRowTotals(counts);
+    for (unsigned int r = 0; r < rows.numberRows(); r++) {
+      if (!checkRow(r, &counts.at(r, 0)))
+        return false;
+    }
+  } else {
+    // Rows are recounted one at a time, so the check does not allocate
+    for (unsigned int r = 0; r < rows.numberRows(); r++) {
+      std::int64_t counts[NUMBER_TOTALS] = {0, 0, 0, 0};
+      countDenseRow(r, counts);
+      if (!checkRow(r, counts))
+        return false;
+    }
+  }
+  return std::equal(recounted, recounted + NUMBER_TOTALS, totals);
 }
 
 int PopulationMatrix::numberServicedAtCoord(const Coord& c) const {
-  return serviced_pop_matrix.at(c.x, c.y);
+  return servicedPop().at(c.x, c.y);
 }
 
 int PopulationMatrix::numberUnservicedAtCoord(const Coord& c) const {
-  return unserviced_pop_matrix.at(c.x, c.y);    
+  return unservicedPop().at(c.x, c.y);    
 }
 
-int PopulationMatrix::numberServicedAtCoordByPlant(const Coord& c, Plant* p) const {
-  return plant_assign_matrix.at(c.x, c.y).at(p);
+int PopulationMatrix::numberTotalAtCoord(const Coord& c) const {
+  return numberServicedAtCoord(c) + numberUnservicedAtCoord(c);
 }
 
-std::unordered_map<Coord, std::pair<int, std::unordered_map<Plant*, int>>> PopulationMatrix::potentialPopForPlant(Plant* p) {
-  std::unordered_map<Coord, std::pair<int, std::unordered_map<Plant*, int>>> result;
-  
-  std::unordered_map<Coord, double> serviceable_area = p->serviceableArea();
-  for (std::pair<Coord, double> element : serviceable_area) {
-    Coord coord = element.first;
-    int num_unserviced = unserviced_pop_matrix.at(coord.x, coord.y);
+int PopulationMatrix::numberServicedAtCoordByPlant(const Coord& c, PlantHandle p) const {
+  return plant_assign_matrix.count(c.x, c.y, p);
+}
 
-    std::unordered_map<Plant*, int> serviced_potential_pop;
+CoordMap<std::pair<int, std::unordered_map<PlantHandle, int>>> PopulationMatrix::potentialPopForPlant(const PlantPool& plants, PlantHandle p) {
+  const CoverageStencil& serviceable_area = plants.serviceableArea(p);
+  CoordMap<std::pair<int, std::unordered_map<PlantHandle, int>>> result(serviceable_area.gridCols());
+  result.reserve(serviceable_area.size());
+
+  forEachPotentialPop(plants, p, [&](const Coord& coord, double, int num_unserviced, const std::vector<PlantServing>& farther) {
+    std::pair<int, std::unordered_map<PlantHandle, int>>& element = result[coord];
+    element.first = num_unserviced;
+    for (const PlantServing& serving : farther)
+      element.second[serving.plant] = serving.count;
+  });
+  return result;
+}
 
-    for (std::pair<Plant*, int> pairing : plant_assign_matrix.at(coord.x, coord.y)) {
-      Plant* plant = pairing.first;
-      if (plant->distanceToCoord(coord) > element.second) {
-        serviced_potential_pop[pairing.first] = pairing.second;
-      }
+void PopulationMatrix::moveServicedPopBetweenPlants(PlantHandle from, PlantHandle to, const Coord& c, int num_pop) {
+  plant_assign_matrix.add(c.x, c.y, from, -num_pop);
+  plant_assign_matrix.add(c.x, c.y, to, num_pop);
+}
 
-    }
-    result[coord] = std::pair<int, std::unordered_map<Plant*, int>>(num_unserviced, serviced_potential_pop);
-  } 
-  return result;
+void PopulationMatrix::assignUnservicedPop(PlantHandle p, const Coord& c, int num_pop) {
+  PopCount& unserviced = sparse ? sparse_unserviced_pop.at(c.x, c.y) : unserviced_pop_matrix.at(c.x, c.y);
+  PopCount& serviced = sparse ? sparse_serviced_pop.at(c.x, c.y) : serviced_pop_matrix.at(c.x, c.y);
+  PopCount unserviced_before = unserviced;
+  PopCount serviced_before = serviced;
+  unserviced = expr::saturate<PopCount>(unserviced - num_pop);
+  serviced = expr::saturate<PopCount>(serviced + num_pop);
+  changeTotals(UNSERVICED_SUM, c.x, unserviced_before, unserviced);
+  changeTotals(SERVICED_SUM, c.x, serviced_before, serviced);
+  plant_assign_matrix.add(c.x, c.y, p, num_pop);
 }
 
-void PopulationMatrix::moveServicedPopBetweenPlants(Plant* from, Plant* to, const Coord& c, int num_pop) {
-  plant_assign_matrix.at(c.x, c.y)[from] -= num_pop;
-  plant_assign_matrix.at(c.x, c.y)[to] += num_pop;
+void PopulationMatrix::unassignServicedPop(PlantHandle p, const Coord& c, int num_pop) {
+  assignUnservicedPop(p, c, -num_pop);
 }
 
-void PopulationMatrix::assignUnservicedPop(Plant* p, const Coord& c, int num_pop) {
-  unserviced_pop_matrix.at(c.x, c.y) -= num_pop;
-  serviced_pop_matrix.at(c.x,c.y) += num_pop;
-  plant_assign_matrix.at(c.x, c.y)[p] += num_pop;    
+void PopulationMatrix::addUnservicedPop(const Matrix<PopCount>& newUnserviced) {
+  if (sparse)
+    sparse_unserviced_pop.addAssign(newUnserviced);
+  else
+    MatrixKernels::addInto(unserviced_pop_matrix.write(), newUnserviced.view());
+  recountTotals();
 }
 
-void PopulationMatrix::addUnservicedPop(Matrix<int>& newUnserviced) {
-  for (int i = 0; i < unserviced_pop_matrix.numberRows(); i++) {
-    for (int j = 0; j < unserviced_pop_matrix.numberCols(); j++) {
-      unserviced_pop_matrix.at(i,j) += newUnserviced.at(i,j);
-    }
-  }
+PopulationLayer PopulationMatrix::servicedPop() const {
+  return sparse ? PopulationLayer(sparse_serviced_pop) : PopulationLayer(serviced_pop_matrix.read());
 }
 
-Matrix<int> PopulationMatrix::totalPopMatrix() const {
-  Matrix<int> combinedPopMatrix = Matrix<int>(serviced_pop_matrix.numberRows(), serviced_pop_matrix.numberCols());
-  for (int i = 0; i < serviced_pop_matrix.numberRows(); i++) {
-    for (int j = 0; j < serviced_pop_matrix.numberCols(); j++) {
-      combinedPopMatrix.at(i,j) = serviced_pop_matrix.at(i,j)+ unserviced_pop_matrix.at(i,j);
-    }
-  }
-  return combinedPopMatrix;
+PopulationLayer PopulationMatrix::unservicedPop() const {
+  return sparse ? PopulationLayer(sparse_unserviced_pop) : PopulationLayer(unserviced_pop_matrix.read());
+}
+
+std::int64_t PopulationMatrix::unservicedTotal() const {
+  return totals[UNSERVICED_SUM];
+}
+
+std::int64_t PopulationMatrix::unservicedSumOfSquares() const {
+  return totals[UNSERVICED_SQUARES];
+}
+
+std::int64_t PopulationMatrix::servicedTotal() const {
+  return totals[SERVICED_SUM];
+}
+
+bool PopulationMatrix::isSparse() const {
+  return sparse;
+}
+
+Matrix<PopCount> PopulationMatrix::totalPopMatrix() const {
+  Matrix<PopCount> total(sizeX(), sizeY(), MATRIX_GRID);
+  assign(total, totalPop());
+  return total;
+}
+
+Matrix<PopCount> PopulationMatrix::servicedPopMatrix() const {
+  if (!sparse)
+    return serviced_pop_matrix.read();
+  Matrix<PopCount> result(sizeX(), sizeY(), MATRIX_GRID);
+  sparse_serviced_pop.copyTo(result);
+  return result;
+}
+
+Matrix<PopCount> PopulationMatrix::unservicedPopMatrix() const {
+  if (!sparse)
+    return unserviced_pop_matrix.read();
+  Matrix<PopCount> result(sizeX(), sizeY(), MATRIX_GRID);
+  sparse_unserviced_pop.copyTo(result);
+  return result;
 }
 
-Matrix<int> PopulationMatrix::servicedPopMatrix() const {
-  return serviced_pop_matrix;
+MatrixView<PopCount> PopulationMatrix::servicedPopView() const {
+  requireDense(sparse);
+  return serviced_pop_matrix.view();
 }
 
-Matrix<int> PopulationMatrix::unservicedPopMatrix() const {
-  return unserviced_pop_matrix;
+MatrixView<PopCount> PopulationMatrix::unservicedPopView() const {
+  requireDense(sparse);
+  return unserviced_pop_matrix.view();
 }
 
 
 int PopulationMatrix::sizeX() const {
-  return serviced_pop_matrix.numberRows();
+  return plant_assign_matrix.numberRows();
 }
 
 int PopulationMatrix::sizeY() const {
-  return serviced_pop_matrix.numberRows();
+  return plant_assign_matrix.numberCols();
 }  
\ No newline at end of file
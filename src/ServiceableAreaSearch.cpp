@@ -0,0 +1,118 @@
+#include "../include/ServiceableAreaSearch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+using namespace MARS;
+
+ServiceableAreaSearch::ServiceableAreaSearch():
+  epoch(0)
+{
+}
+
+void ServiceableAreaSearch::startSearch(std::size_t cells, int max_cost) {
+  if (labels.size() < cells)
+    labels.resize(cells, Label());
+  if (buckets.size() < (std::size_t) max_cost + 1)
+    buckets.resize(max_cost + 1);
+  epoch++;
+  if (epoch == 0) {
+    // Wrapped around, so old labels could collide with new searches
+    std::fill(labels.begin(), labels.end(), Label());
+    epoch = 1;
+  }
+}
+
+bool ServiceableAreaSearch::uniformGrass(const Terrain& terrain, const Coord& source, int radius) {
+  if (source.x - radius < 0 || source.y - radius < 0
+      || source.x + radius >= terrain.sizeX() || source.y + radius >= terrain.sizeY())
+    return false;
+  const BitMatrix& non_grass = terrain.nonGrassMask();
+  for (int dx = -radius; dx <= radius; dx++) {
+    int span = radius - std::abs(dx);
+    int row = source.x + dx;
+    int end = source.y + span + 1;
+    int found = non_grass.findNextInRow(row, source.y - span, end);
+    if (dx == 0 && found == source.y)
+      found = non_grass.findNextInRow(row, source.y + 1, end); // The plant's own cell does not count
+    if (found >= 0)
+      return false;
+  }
+  return true;
+}
+
+void ServiceableAreaSearch::run(const Terrain& terrain, const Coord& source, double serve_dist, CoverageStencil& area) {
+  found.clear();
+  if (!(serve_dist >= 0) || source.x < 0 || source.y < 0 || source.x >= terrain.sizeX() || source.y >= terrain.sizeY()) {
+    area = CoverageStencil(terrain.sizeY());
+    return;
+  }
+
+  const std::uint32_t grass_cost = terrain.grassStepCost();
+  if (grass_cost > 0 && serve_dist < std::numeric_limits<int>::max()) {
+    int radius = (int) (std::floor(serve_dist) / grass_cost);
+    if (uniformGrass(terrain, source, radius)) {
+      area = CoverageStencil(CoverageShape::diamond(radius, grass_cost), source, terrain.sizeY());
+      return;
+    }
+  }
+
+  const Matrix<std::uint8_t>& costs = terrain.stepCosts();
+  const std::uint8_t* cost = costs.ptr();
+  const std::size_t stride = costs.stride();
+  const int max_cost = std::max(terrain.maxStepCost(), 1);
+  // Costs are whole numbers, so a distance is within reach iff it is within the floor
+  const std::uint32_t limit = (std::uint32_t) std::min(std::floor(serve_dist),
+    (double) (std::numeric_limits<std::uint32_t>::max() - IMPASSABLE_STEP_COST));
+  const std::size_t number_buckets = max_cost + 1;
+  const std::uint64_t grid_cols = terrain.sizeY();
+
+  startSearch((std::size_t) costs.numberRows() * stride, max_cost);
+  Label* label = labels.data();
+
+  // Grid cells are one row and column in from their padded positions
+  const std::uint32_t start = (std::uint32_t) ((source.x + 1) * stride + source.y + 1);
+  const std::int64_t offsets[4] = {-1, 1, -(std::int64_t) stride, (std::int64_t) stride};
+  label[start].epoch = epoch;
+  label[start].dist = 0;
+  buckets[0].push_back(start);
+  std::size_t pending = 1;
+
+  for (std::uint32_t dist = 0; pending > 0; dist++) {
+    std::vector<std::uint32_t>& bucket = buckets[dist % number_buckets];
+    // Cells pushed into this bucket while expanding it have the same distance
+    for (std::size_t i = 0; i < bucket.size(); i++) {
+      std::uint32_t cell = bucket[i];
+      pending--;
+      if (label[cell].dist != dist)
+        continue; // Stale, a shorter path was found after it was pushed
+      if (cell != start) {
+        std::uint64_t grid_cell = (cell / stride - 1) * grid_cols + cell % stride - 1;
+        found.push_back(grid_cell << 32 | dist);
+      }
+
+      for (int n = 0; n < 4; n++) {
+        std::uint32_t next = (std::uint32_t) (cell + offsets[n]);
+        std::uint32_t step = cost[next];
+        if (step >= IMPASSABLE_STEP_COST)
+          continue;
+        std::uint32_t next_dist = dist + step;
+        if (next_dist > limit)
+          continue;
+        Label& next_label = label[next];
+        if (next_label.epoch == epoch && next_label.dist <= next_dist)
+          continue;
+        next_label.epoch = epoch;
+        next_label.dist = next_dist;
+        buckets[next_dist % number_buckets].push_back(next);
+        pending++;
+      }
+    }
+    bucket.clear();
+  }
+
+  std::sort(found.begin(), found.end());
+  area = CoverageStencil(std::make_shared<CoverageShape>(source, terrain.sizeY(), found), source, terrain.sizeY());
+}
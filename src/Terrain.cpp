@@ -1,23 +1,77 @@
 #include "Terrain.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <cmath>
 
 using namespace MARS;
 
-Terrain::Terrain(int dx, int dy): perlin(std::time(NULL)), size_x(dx), size_y(dy), terrainMatrix(dx, dy), weightMatrix(dx, dy) {
+static std::uint64_t nextGenerationId() {
+  static std::atomic<std::uint64_t> next_id(1);
+  return next_id++;
+}
+
+Terrain::Terrain(int dx, int dy): perlin(std::time(NULL)), size_x(dx), size_y(dy), terrainMatrix(dx, dy, MATRIX_GRID), weightMatrix(dx, dy, MATRIX_GRID), stepCostMatrix(0, 0) {
+  generate();
+  buildStepCosts();
+}
+
+static std::string weightsFile(const std::string& path) {
+  return path + ".weights.mat";
+}
+
+static std::string typesFile(const std::string& path) {
+  return path + ".types.mat";
+}
+
+template <class T>
+static Matrix<T> terrainLayer(const std::string& file, int dx, int dy, bool reuse) {
+  if (reuse)
+    return Matrix<T>::openFile(file);
+  return Matrix<T>::createFile(file, dx, dy, MATRIX_PADDED);
+}
+
+Terrain::Terrain(int dx, int dy, const std::string& path) :
+  Terrain(dx, dy, path,
+    Matrix<float>::fileMatches(weightsFile(path), dx, dy) && Matrix<int>::fileMatches(typesFile(path), dx, dy))
+{
+}
+
+Terrain::Terrain(int dx, int dy, const std::string& path, bool reuse) :
+  perlin(std::time(NULL)),
+  size_x(dx),
+  size_y(dy),
+  terrainMatrix(terrainLayer<int>(typesFile(path), dx, dy, reuse)),
+  weightMatrix(terrainLayer<float>(weightsFile(path), dx, dy, reuse)),
+  stepCostMatrix(0, 0)
+{
+  if (!reuse) {
+    weightMatrix.read().advise(MATRIX_ACCESS_SEQUENTIAL);
+    terrainMatrix.read().advise(MATRIX_ACCESS_SEQUENTIAL);
+    generate();
+  }
+  buildStepCosts();
+  // Serviceable area searches read small neighbourhoods scattered over the grid
+  weightMatrix.read().advise(MATRIX_ACCESS_RANDOM);
+  terrainMatrix.read().advise(MATRIX_ACCESS_NORMAL);
+}
+
+void Terrain::generate() {
+  Matrix<int>& types = terrainMatrix.write();
+  Matrix<float>& weights = weightMatrix.write();
   for (int i = 0; i < size_x; i++) {
     for (int j = 0; j < size_y; j++) {
       float value = perlin.noise0_1(i/std::log2(size_x), j/std::log2(size_x));
       if (value >= MOUNTAIN_THRESHOLD) {
-        terrainMatrix.at(i, j) = 1;
-        weightMatrix.at(i, j) = MOUNTAIN_WEIGHT;
+        types.at(i, j) = 1;
+        weights.at(i, j) = MOUNTAIN_WEIGHT;
       } else if (value >= GRASSLAND_THRESHOLD) {
-        terrainMatrix.at(i, j) = 0;
-        weightMatrix.at(i, j) = GRASSLAND_WEIGHT;
+        types.at(i, j) = 0;
+        weights.at(i, j) = GRASSLAND_WEIGHT;
       } else {
-        terrainMatrix.at(i, j) = 2;
-        weightMatrix.at(i, j) = WATER_WEIGHT;
+        types.at(i, j) = 2;
+        weights.at(i, j) = WATER_WEIGHT;
       }
     }
   }
@@ -27,8 +81,9 @@ Terrain::Terrain(int dim) :
   perlin(std::time(NULL)),
   size_x(dim),
   size_y(dim),
-  terrainMatrix(dim, dim),
-  weightMatrix(dim, dim)
+  terrainMatrix(dim, dim, MATRIX_GRID),
+  weightMatrix(dim, dim, MATRIX_GRID),
+  stepCostMatrix(0, 0)
 {
   //std::cout << "In this constructor" << std::endl;
   for (int i=0; i<dim; i++) {
@@ -37,14 +92,16 @@ Terrain::Terrain(int dim) :
     //std::cout << "Coordinate (" << i << "," << j << "):" << weightAtXY(i,j) << std::endl;
     }
   }
+  buildStepCosts();
 }
 
 Terrain::Terrain(int x, int y, bool water) :
   perlin(std::time(NULL)),
   size_x(x),
   size_y(y),
-  terrainMatrix(x,y),
-  weightMatrix(x, y)
+  terrainMatrix(x, y, MATRIX_GRID),
+  weightMatrix(x, y, MATRIX_GRID),
+  stepCostMatrix(0, 0)
 {
   for (int i=0; i<x; i++) {
     for (int j=0; j<y; j++) {
@@ -56,6 +113,32 @@ Terrain::Terrain(int x, int y, bool water) :
   weightMatrix.at(1,0) = WATER_WEIGHT;
   weightMatrix.at(1,2) = WATER_WEIGHT;
   weightMatrix.at(2,1) = WATER_WEIGHT;
+  buildStepCosts();
+}
+
+void Terrain::buildStepCosts() {
+  Matrix<std::uint8_t> costs(size_x + 2, size_y + 2, MATRIX_GRID);
+  std::shared_ptr<BitMatrix> mask = std::make_shared<BitMatrix>(size_x, size_y);
+  const Matrix<float>& weights = weightMatrix.read();
+  max_step_cost = 0;
+  for (int i = 0; i < size_x + 2; i++) {
+    for (int j = 0; j < size_y + 2; j++) {
+      int cost = IMPASSABLE_STEP_COST;
+      if (i > 0 && j > 0 && i <= size_x && j <= size_y) {
+        float weight = weights.at(i - 1, j - 1);
+        if (weight < IMPASSABLE_STEP_COST) {
+          cost = (int) std::ceil(std::max(weight, 0.0f));
+          max_step_cost = std::max(max_step_cost, cost);
+        }
+        if (cost != grassStepCost())
+          mask->set(i - 1, j - 1, true);
+      }
+      costs.at(i, j) = (std::uint8_t) cost;
+    }
+  }
+  stepCostMatrix = SharedMatrix<std::uint8_t>(std::move(costs));
+  non_grass_mask = mask;
+  generation_id = nextGenerationId();
 }
 
 int Terrain::sizeX() const {
@@ -75,9 +158,37 @@ float Terrain::weightAtCoord(const Coord& c) const {
 }
 
 Matrix<float> Terrain::getMatrixCopy() const {
-  return weightMatrix;
+  return weightMatrix.read();
 }
 
 Matrix<int> Terrain::getTerrainMatrix() const {
-  return terrainMatrix;
+  return terrainMatrix.read();
+}
+
+MatrixView<float> Terrain::weightView() const {
+  return weightMatrix.view();
+}
+
+MatrixView<int> Terrain::terrainView() const {
+  return terrainMatrix.view();
+}
+
+const Matrix<std::uint8_t>& Terrain::stepCosts() const {
+  return stepCostMatrix.read();
+}
+
+int Terrain::maxStepCost() const {
+  return max_step_cost;
+}
+
+int Terrain::grassStepCost() const {
+  return (int) std::ceil(GRASSLAND_WEIGHT);
+}
+
+const BitMatrix& Terrain::nonGrassMask() const {
+  return *non_grass_mask;
+}
+
+std::uint64_t Terrain::generationId() const {
+  return generation_id;
 }
\ No newline at end of file